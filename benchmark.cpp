@@ -0,0 +1,646 @@
+//
+// Benchmark of the coders on corpus sources (corpus.h): synthetic inputs, the enwiki8 prefix, files and directories:
+//
+// rans-benchmark [-v variant,...] [-d source,...] [-n size,...|min..max] [-r repetitions] [-w warmup] [--json]
+//
+// The histogram, the normalization, the table build, the encoding and the decoding are timed separately.
+// Every phase runs warmup times untimed and then repetitions times, and the median with the 10th and 90th
+// percentiles of the single runs is reported along with MB/s and cycles/byte of the median. Cycles are the
+// time stamp counter ticks where it exists. Every variant is checked to decode its own output.
+// The -pN variants code with N bits of probability precision (STATE_BITS for the fixed-accuracy coders) instead
+// of 14; the tables of the encoder and of the decoder are reported with whether the latter fit the L1 data cache.
+// Every source is measured at every size (256..4G sweeps by 4x, 0 is the size of the source itself), and the
+// smallest cache level holding the input is reported. The runs are cut to keep about 1 GB per phase, but not
+// below 3; the sizes whose stream bound does not fit the int sizes of a coder are skipped for it.
+//
+
+#include <iostream>
+#include <iomanip>
+#include <algorithm>
+#include <bit>
+#include <chrono>
+#include <climits>
+#include <cmath>
+#include <memory>
+#include <random>
+#include <span>
+#include <string>
+#include <vector>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#if defined(__unix__) || defined(__APPLE__)
+#include <unistd.h>
+#endif
+
+#if defined(_MSC_VER)
+#include <intrin.h>
+#define HAVE_RDTSC 1
+#elif defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#define HAVE_RDTSC 1
+#else
+#define HAVE_RDTSC 0
+#endif
+
+#include "rans.h"
+#include "rans-fast.h"
+#include "rans-avx2.h"
+#include "rans-fixed-accuracy.h"
+#include "rans-order1.h"
+#include "stream-header.h"
+#include "sym-stats.h"
+#include "cpu-features.h"
+#include "corpus.h"
+
+// the fixed-accuracy decoders may read a few bytes before the start of the stream
+static constexpr size_t PAYLOAD_OFFSET = 8;
+
+static inline uint64_t read_cycles() {
+#if HAVE_RDTSC
+    return __rdtsc();
+#else
+    return 0;
+#endif
+}
+
+// 32 KB where the OS does not report it
+static size_t l1_data_cache_size() {
+#if defined(_SC_LEVEL1_DCACHE_SIZE)
+    long size = sysconf(_SC_LEVEL1_DCACHE_SIZE);
+    if (size > 0)
+        return (size_t)size;
+#endif
+    return 32 * 1024;
+}
+
+// the smallest cache level holding bytes, 1 MB of L2 and 32 MB of L3 where the OS does not report them
+static const char* cache_level(size_t bytes) {
+    size_t l2 = 1 << 20, l3 = 32 << 20;
+#if defined(_SC_LEVEL2_CACHE_SIZE) && defined(_SC_LEVEL3_CACHE_SIZE)
+    if (sysconf(_SC_LEVEL2_CACHE_SIZE) > 0)
+        l2 = (size_t)sysconf(_SC_LEVEL2_CACHE_SIZE);
+    if (sysconf(_SC_LEVEL3_CACHE_SIZE) > 0)
+        l3 = (size_t)sysconf(_SC_LEVEL3_CACHE_SIZE);
+#endif
+    return bytes <= l1_data_cache_size() ? "L1" : bytes <= l2 ? "L2" : bytes <= l3 ? "L3" : "DRAM";
+}
+
+
+
+//
+// Coders under test
+//
+
+class Coder {
+public:
+    virtual ~Coder() = default;
+    virtual size_t max_encoded_size(size_t n) const = 0;
+    // the total of the normalized frequencies
+    virtual uint32_t prob_scale() const = 0;
+    // the tables for stats normalized to prob_scale, the context models count their statistics on in
+    virtual void build(const SymbolStats& stats, std::span<const uint8_t> in) = 0;
+    // the memory of the tables used by the encoder and by the decoder
+    virtual size_t enc_table_bytes() const = 0;
+    virtual size_t dec_table_bytes() const = 0;
+    // the model stored for the decoder: the frequency table of the stream header by default
+    virtual size_t model_size(const SymbolStats& stats) const {
+        if (std::all_of(std::begin(stats.freqs), std::end(stats.freqs), [](uint32_t f) { return f == 0; }))
+            return 0;
+        uint8_t table[MAX_FREQ_TABLE_SIZE];
+        return write_freq_table(stats.freqs, table) - table;
+    }
+    // returns the part of buf taken by the stream
+    virtual std::span<const uint8_t> encode(std::span<const uint8_t> in, std::span<uint8_t> buf) = 0;
+    virtual void decode(std::span<const uint8_t> stream, std::span<uint8_t> out) = 0;
+};
+
+template <int PROB_BITS>
+class Rans64Coder : public Coder {
+public:
+    size_t max_encoded_size(size_t n) const override { return Rans64<PROB_BITS>::max_encoded_size(n); }
+    uint32_t prob_scale() const override { return 1 << PROB_BITS; }
+
+    void build(const SymbolStats& stats, std::span<const uint8_t>) override { ctx->init(stats); }
+    size_t enc_table_bytes() const override { return sizeof(ctx->esyms); }
+    size_t dec_table_bytes() const override { return sizeof(ctx->dsyms) + sizeof(ctx->cum2sym); }
+
+    std::span<const uint8_t> encode(std::span<const uint8_t> in, std::span<uint8_t> buf) override {
+        return buf.last(Rans64<PROB_BITS>::encode(in, buf, ctx->esyms));
+    }
+
+    void decode(std::span<const uint8_t> stream, std::span<uint8_t> out) override {
+        Rans64<PROB_BITS>::decode(ctx->dsyms, ctx->cum2sym, stream.data(), stream.data() + stream.size(), out.data(), out.size());
+    }
+
+private:
+    std::unique_ptr<typename Rans64<PROB_BITS>::Context> ctx = std::make_unique<typename Rans64<PROB_BITS>::Context>();
+};
+
+template <int PROB_BITS>
+class RansFast64Coder : public Coder {
+public:
+    size_t max_encoded_size(size_t n) const override { return RansFast64<PROB_BITS>::max_encoded_size(n); }
+    uint32_t prob_scale() const override { return 1 << PROB_BITS; }
+
+    void build(const SymbolStats& stats, std::span<const uint8_t>) override { ctx->init(stats); }
+    size_t enc_table_bytes() const override { return sizeof(ctx->esyms); }
+    size_t dec_table_bytes() const override { return sizeof(ctx->dsyms) + sizeof(ctx->cum2sym); }
+
+    std::span<const uint8_t> encode(std::span<const uint8_t> in, std::span<uint8_t> buf) override {
+        return buf.last(RansFast64<PROB_BITS>::encode(in, buf, ctx->esyms));
+    }
+
+    void decode(std::span<const uint8_t> stream, std::span<uint8_t> out) override {
+        RansFast64<PROB_BITS>::decode(ctx->dsyms, ctx->cum2sym, stream.data(), stream.data() + stream.size(), out.data(), out.size());
+    }
+
+private:
+    std::unique_ptr<typename RansFast64<PROB_BITS>::Context> ctx = std::make_unique<typename RansFast64<PROB_BITS>::Context>();
+};
+
+template <int PROB_BITS>
+class RansAvx2Coder : public Coder {
+public:
+    size_t max_encoded_size(size_t n) const override { return RansAvx2<PROB_BITS>::max_encoded_size(n); }
+    uint32_t prob_scale() const override { return 1 << PROB_BITS; }
+
+    void build(const SymbolStats& stats, std::span<const uint8_t>) override {
+        ctx->init(stats);
+        RansAvx2<PROB_BITS>::init_dec_tables(ctx->dsyms, ctx->cum2sym, tables);
+    }
+
+    size_t enc_table_bytes() const override { return sizeof(ctx->esyms); }
+    size_t dec_table_bytes() const override { return tables.slots.size() * sizeof(uint32_t) + tables.cum2sym.size(); }
+
+    std::span<const uint8_t> encode(std::span<const uint8_t> in, std::span<uint8_t> buf) override {
+        return buf.last(RansAvx2<PROB_BITS>::encode(in, buf, ctx->esyms));
+    }
+
+    void decode(std::span<const uint8_t> stream, std::span<uint8_t> out) override {
+        RansAvx2<PROB_BITS>::decode(tables, stream.data(), stream.data() + stream.size(), out.data(), out.size());
+    }
+
+private:
+    std::unique_ptr<typename Rans64<PROB_BITS>::Context> ctx = std::make_unique<typename Rans64<PROB_BITS>::Context>();
+    RansAvx2DecTables tables;
+};
+
+enum DecodeMethod {
+    DECODE_SYMBOLS,     // cum2sym and dsyms lookups
+    DECODE_FUSED,       // init_dec_slots
+    DECODE_TABLE        // init_dec_states
+};
+
+template <typename Rans, int N, DecodeMethod METHOD>
+class FixedAccuracyCoder : public Coder {
+public:
+    size_t max_encoded_size(size_t n) const override { return Rans::max_encoded_size(n, N); }
+    uint32_t prob_scale() const override { return Rans::STATE_MASK + 1; }
+
+    void build(const SymbolStats& stats, std::span<const uint8_t>) override {
+        ctx->init(stats);
+        if (METHOD == DECODE_FUSED)
+            ctx->init_dec_slots();
+        else if (METHOD == DECODE_TABLE)
+            states = Rans::init_dec_states(ctx->dsyms, ctx->cum2sym);
+    }
+
+    size_t enc_table_bytes() const override { return sizeof(ctx->esyms); }
+
+    size_t dec_table_bytes() const override {
+        if (METHOD == DECODE_FUSED)
+            return sizeof(ctx->slots);
+        else if (METHOD == DECODE_TABLE)
+            return states.size() * sizeof(states[0]);
+        return sizeof(ctx->dsyms) + sizeof(ctx->cum2sym);
+    }
+
+    std::span<const uint8_t> encode(std::span<const uint8_t> in, std::span<uint8_t> buf) override {
+        if constexpr (N == 1)
+            return buf.first(Rans::encode(in, buf, ctx->esyms));
+        else
+            return buf.first(Rans::template encode_interleaved<N>(in, buf, ctx->esyms));
+    }
+
+    void decode(std::span<const uint8_t> stream, std::span<uint8_t> out) override {
+        const uint8_t* end = stream.data() + stream.size();
+        uint8_t* out_end = out.data() + out.size();
+        if constexpr (N == 1) {
+            if (METHOD == DECODE_FUSED)
+                Rans::decode_fused(ctx->slots, stream.data(), end, out.data(), out_end);
+            else if (METHOD == DECODE_TABLE)
+                Rans::decode_table(states.data(), stream.data(), end, out.data(), out_end);
+            else
+                Rans::decode(ctx->dsyms, ctx->cum2sym, stream.data(), end, out.data(), out_end);
+        } else {
+            if (METHOD == DECODE_FUSED)
+                Rans::template decode_fused_interleaved<N>(ctx->slots, stream.data(), end, out.data(), out_end);
+            else if (METHOD == DECODE_TABLE)
+                Rans::template decode_table_interleaved<N>(states.data(), stream.data(), end, out.data(), out_end);
+            else
+                Rans::template decode_interleaved<N>(ctx->dsyms, ctx->cum2sym, stream.data(), end, out.data(), out_end);
+        }
+    }
+
+private:
+    std::unique_ptr<typename Rans::Context> ctx = std::make_unique<typename Rans::Context>();
+    std::vector<typename Rans::DecStateInfo> states;
+};
+
+// the model is built while coding, the build phase has nothing to do
+template <typename Rans>
+class AdaptiveCoder : public Coder {
+public:
+    size_t max_encoded_size(size_t n) const override { return Rans::max_encoded_size(n); }
+    uint32_t prob_scale() const override { return Rans::STATE_MASK + 1; }
+
+    void build(const SymbolStats&, std::span<const uint8_t>) override {}
+    // the model is rebuilt on the coder's stack
+    size_t enc_table_bytes() const override { return 0; }
+    size_t dec_table_bytes() const override { return 0; }
+    size_t model_size(const SymbolStats&) const override { return 0; }
+
+    std::span<const uint8_t> encode(std::span<const uint8_t> in, std::span<uint8_t> buf) override {
+        return buf.first(Rans::encode_adaptive(in, buf));
+    }
+
+    void decode(std::span<const uint8_t> stream, std::span<uint8_t> out) override {
+        Rans::decode_adaptive(stream.data(), stream.data() + stream.size(), out.data(), out.data() + out.size());
+    }
+};
+
+// 256 models selected by the previous byte, counted in the build phase
+template <typename Order1>
+class Order1Coder : public Coder {
+public:
+    size_t max_encoded_size(size_t n) const override { return Order1::max_encoded_size(n); }
+    uint32_t prob_scale() const override { return Order1::Rans::STATE_MASK + 1; }
+
+    void build(const SymbolStats&, std::span<const uint8_t> in) override { Order1::init(in, model); }
+    size_t enc_table_bytes() const override { return model.esyms.size() * sizeof(model.esyms[0]); }
+    size_t dec_table_bytes() const override { return model.table_bytes() - enc_table_bytes(); }
+
+    size_t model_size(const SymbolStats&) const override {
+        std::vector<uint8_t> out(Order1::max_model_size(model));
+        return Order1::write_model(model, out.data());
+    }
+
+    std::span<const uint8_t> encode(std::span<const uint8_t> in, std::span<uint8_t> buf) override {
+        return buf.first(Order1::encode(in, buf, model));
+    }
+
+    void decode(std::span<const uint8_t> stream, std::span<uint8_t> out) override {
+        Order1::decode(model, stream.data(), stream.data() + stream.size(), out.data(), out.data() + out.size());
+    }
+
+private:
+    typename Order1::Model model;
+};
+
+template <typename T>
+static std::unique_ptr<Coder> make_coder() {
+    return std::make_unique<T>();
+}
+
+struct Variant {
+    const char* name;
+    std::unique_ptr<Coder> (*make)();
+};
+
+static const Variant variants[] = {
+    { "rans", make_coder<Rans64Coder<14>> },
+    { "rans-p10", make_coder<Rans64Coder<10>> },
+    { "rans-p12", make_coder<Rans64Coder<12>> },
+    { "rans-p16", make_coder<Rans64Coder<16>> },
+    { "rans-fast", make_coder<RansFast64Coder<14>> },
+    { "rans-fast-p12", make_coder<RansFast64Coder<12>> },
+    { "rans-fast-p16", make_coder<RansFast64Coder<16>> },
+    { "rans-avx2", make_coder<RansAvx2Coder<14>> },
+    { "rans-avx2-p10", make_coder<RansAvx2Coder<10>> },
+    { "rans-avx2-p12", make_coder<RansAvx2Coder<12>> },
+    { "rans-avx2-p16", make_coder<RansAvx2Coder<16>> },
+    { "acc3", make_coder<FixedAccuracyCoder<RansWithAccuracy3, 1, DECODE_SYMBOLS>> },
+    { "acc3-p10", make_coder<FixedAccuracyCoder<FixedAccuracyRans<10, 3>, 1, DECODE_SYMBOLS>> },
+    { "acc3-p12", make_coder<FixedAccuracyCoder<FixedAccuracyRans<12, 3>, 1, DECODE_SYMBOLS>> },
+    { "acc3-p16", make_coder<FixedAccuracyCoder<FixedAccuracyRans<16, 3>, 1, DECODE_SYMBOLS>> },
+    { "acc3-fused", make_coder<FixedAccuracyCoder<RansWithAccuracy3, 1, DECODE_FUSED>> },
+    { "acc3-fused-p10", make_coder<FixedAccuracyCoder<FixedAccuracyRans<10, 3>, 1, DECODE_FUSED>> },
+    { "acc3-fused-p12", make_coder<FixedAccuracyCoder<FixedAccuracyRans<12, 3>, 1, DECODE_FUSED>> },
+    { "acc3-table", make_coder<FixedAccuracyCoder<RansWithAccuracy3, 1, DECODE_TABLE>> },
+    { "acc3-x2", make_coder<FixedAccuracyCoder<RansWithAccuracy3, 2, DECODE_SYMBOLS>> },
+    { "acc3-x4", make_coder<FixedAccuracyCoder<RansWithAccuracy3, 4, DECODE_SYMBOLS>> },
+    { "acc3-x8", make_coder<FixedAccuracyCoder<RansWithAccuracy3, 8, DECODE_SYMBOLS>> },
+    { "acc3-x4-fused", make_coder<FixedAccuracyCoder<RansWithAccuracy3, 4, DECODE_FUSED>> },
+    { "acc3-adaptive", make_coder<AdaptiveCoder<RansWithAccuracy3>> },
+    { "acc3-o1", make_coder<Order1Coder<Order1RansWithAccuracy3>> },
+    { "acc3-o1-p12", make_coder<Order1Coder<Order1Rans<12, 3>>> },
+    { "acc2", make_coder<FixedAccuracyCoder<RansWithAccuracy2, 1, DECODE_SYMBOLS>> },
+    { "acc2-fused", make_coder<FixedAccuracyCoder<RansWithAccuracy2, 1, DECODE_FUSED>> },
+    { "acc2-table", make_coder<FixedAccuracyCoder<RansWithAccuracy2, 1, DECODE_TABLE>> },
+    { "acc2-x2", make_coder<FixedAccuracyCoder<RansWithAccuracy2, 2, DECODE_SYMBOLS>> },
+    { "acc2-x4", make_coder<FixedAccuracyCoder<RansWithAccuracy2, 4, DECODE_SYMBOLS>> },
+    { "acc2-x8", make_coder<FixedAccuracyCoder<RansWithAccuracy2, 8, DECODE_SYMBOLS>> },
+    { "acc2-x4-fused", make_coder<FixedAccuracyCoder<RansWithAccuracy2, 4, DECODE_FUSED>> },
+    { "acc2-adaptive", make_coder<AdaptiveCoder<RansWithAccuracy2>> },
+    { "acc2-o1", make_coder<Order1Coder<Order1RansWithAccuracy2>> },
+};
+
+
+//
+// Inputs
+//
+
+static const char* default_sources[] = { "geo:0.7", "geo:0.3", "uniform", "enwiki" };
+
+
+//
+// Measurement
+//
+
+struct BenchParams {
+    std::vector<size_t> sizes = { 1 << 16 };
+    int repetitions = 21;
+    int warmup = 3;
+};
+
+struct PhaseStats {
+    const char* name;
+    double median_ns, p10_ns, p90_ns;
+    double cycles_per_byte;
+    size_t bytes;
+};
+
+// linear interpolation between the closest ranks of the sorted samples
+static double percentile(const std::vector<double>& sorted, double p) {
+    double pos = p * (sorted.size() - 1);
+    size_t lo = (size_t)pos;
+    size_t hi = std::min(lo + 1, sorted.size() - 1);
+    return sorted[lo] + (sorted[hi] - sorted[lo]) * (pos - lo);
+}
+
+// before runs untimed ahead of every run, e.g. to restore the input of an in-place phase
+template <typename Run, typename Before>
+static PhaseStats measure(const char* name, size_t bytes, const BenchParams& params, Run run, Before before) {
+    using namespace std::chrono;
+
+    std::vector<double> ns, cycles;
+    for (int i = 0; i < params.warmup + params.repetitions; i++) {
+        before();
+        auto t1 = steady_clock::now();
+        uint64_t c1 = read_cycles();
+        run();
+        uint64_t c2 = read_cycles();
+        auto t2 = steady_clock::now();
+        if (i >= params.warmup) {
+            ns.push_back((double)duration_cast<nanoseconds>(t2 - t1).count());
+            cycles.push_back((double)(c2 - c1));
+        }
+    }
+    std::sort(ns.begin(), ns.end());
+    std::sort(cycles.begin(), cycles.end());
+    return { name, percentile(ns, 0.5), percentile(ns, 0.1), percentile(ns, 0.9),
+        HAVE_RDTSC ? percentile(cycles, 0.5) / std::max<size_t>(bytes, 1) : NAN, bytes };
+}
+
+template <typename Run>
+static PhaseStats measure(const char* name, size_t bytes, const BenchParams& params, Run run) {
+    return measure(name, bytes, params, run, [] {});
+}
+
+struct Result {
+    std::string variant, distribution;
+    const char* cache;
+    size_t size, encoded_size;
+    uint32_t prob_scale;
+    size_t model_size, enc_table_bytes, dec_table_bytes;
+    bool ok;
+    std::vector<PhaseStats> phases;
+};
+
+static Result bench_variant(const Variant& variant, const std::string& source, const std::vector<uint8_t>& sequence,
+    const SymbolStats& counted, const PhaseStats& histogram, const BenchParams& params
+) {
+    std::unique_ptr<Coder> coder = variant.make();
+    Result result = { variant.name, source, cache_level(sequence.size()), sequence.size(), 0, coder->prob_scale(), 0, 0, 0, true, { histogram } };
+
+    SymbolStats stats;
+    result.phases.push_back(measure("normalize", sequence.size(), params, [&] { stats.normalize_freqs(coder->prob_scale()); },
+        [&] { stats = counted; }));
+
+    // the 64-bit rANS writes 32-bit words back from the end of the buffer
+    size_t bound = coder->max_encoded_size(sequence.size());
+    std::vector<uint32_t> storage((PAYLOAD_OFFSET + bound + 3) / 4);
+    std::span<uint8_t> buf((uint8_t*)storage.data() + PAYLOAD_OFFSET, storage.size() * 4 - PAYLOAD_OFFSET);
+    std::vector<uint8_t> decoded(sequence.size());
+
+    result.phases.push_back(measure("tables", sequence.size(), params, [&] { coder->build(stats, sequence); }));
+    std::span<const uint8_t> stream;
+    result.phases.push_back(measure("encode", sequence.size(), params, [&] { stream = coder->encode(sequence, buf); }));
+    result.phases.push_back(measure("decode", sequence.size(), params, [&] { coder->decode(stream, decoded); },
+        [&] { std::fill(decoded.begin(), decoded.end(), 0); }));
+
+    result.encoded_size = stream.size();
+    result.model_size = coder->model_size(stats);
+    result.enc_table_bytes = coder->enc_table_bytes();
+    result.dec_table_bytes = coder->dec_table_bytes();
+    result.ok = stream.size() <= bound && std::equal(sequence.begin(), sequence.end(), decoded.begin());
+    if (!result.ok)
+        std::cerr << "ERROR! " << source << " decompressed incorrectly by " << variant.name << std::endl;
+    return result;
+}
+
+
+//
+// Reporting
+//
+
+// the source and variant columns, widened for long source names such as paths
+static void print_names(const std::string& source, const char* variant) {
+    std::cout << std::left << std::setw(std::max<int>(10, (int)source.size() + 1)) << source << std::setw(15) << variant << std::right;
+}
+
+static void print_text(const Result& r) {
+    print_names(r.distribution, r.variant.c_str());
+    std::cout
+        << r.size << " (" << r.cache << ") -> " << r.encoded_size << " + " << r.model_size << " model bytes, " << std::bit_width(r.prob_scale) - 1 << "-bit precision, "
+        << std::fixed << std::setprecision(1) << r.enc_table_bytes / 1024.0 << "/" << r.dec_table_bytes / 1024.0 << std::defaultfloat
+        << " KB encoder/decoder tables" << (r.dec_table_bytes <= l1_data_cache_size() ? " (decoder in L1)" : "")
+        << (r.ok ? "" : " (round trip FAILED)") << std::endl;
+    for (const PhaseStats& p : r.phases) {
+        std::cout << "    " << std::left << std::setw(10) << p.name << std::right << std::fixed << std::setprecision(1)
+            << "median " << std::setw(9) << p.median_ns / 1000 << " us  p10 " << std::setw(9) << p.p10_ns / 1000
+            << " us  p90 " << std::setw(9) << p.p90_ns / 1000 << " us  " << std::setw(8) << p.bytes / (p.median_ns / 1000) << " MB/s";
+        if (!std::isnan(p.cycles_per_byte))
+            std::cout << std::setprecision(2) << std::setw(8) << p.cycles_per_byte << " cycles/B";
+        std::cout << std::defaultfloat << std::endl;
+    }
+}
+
+// the quotes, backslashes and control characters of text escaped for a JSON string, e.g. in file names
+static std::string json_escaped(const std::string& text) {
+    std::string escaped;
+    for (char c : text) {
+        if (c == '"' || c == '\\') {
+            escaped += '\\';
+            escaped += c;
+        } else if ((unsigned char)c < 0x20) {
+            char code[8];
+            snprintf(code, sizeof(code), "\\u%04x", c);
+            escaped += code;
+        } else {
+            escaped += c;
+        }
+    }
+    return escaped;
+}
+
+static void print_json(const std::vector<Result>& results) {
+    std::cout << "[" << std::endl;
+    for (size_t i = 0; i < results.size(); i++) {
+        const Result& r = results[i];
+        std::cout << "  {\"variant\": \"" << r.variant << "\", \"distribution\": \"" << json_escaped(r.distribution) << "\", \"cpu\": \"" << cpu_level_name(cpu_level())
+            << "\", \"size\": " << r.size << ", \"cache\": \"" << r.cache << "\""
+            << ", \"encoded_size\": " << r.encoded_size << ", \"model_size\": " << r.model_size << ", \"prob_bits\": " << std::bit_width(r.prob_scale) - 1
+            << ", \"enc_table_bytes\": " << r.enc_table_bytes << ", \"dec_table_bytes\": " << r.dec_table_bytes
+            << ", \"dec_tables_in_l1\": " << (r.dec_table_bytes <= l1_data_cache_size() ? "true" : "false") << ", \"ok\": " << (r.ok ? "true" : "false") << ", \"phases\": {";
+        for (size_t j = 0; j < r.phases.size(); j++) {
+            const PhaseStats& p = r.phases[j];
+            std::cout << (j ? ", " : "") << "\"" << p.name << "\": {\"median_ns\": " << p.median_ns << ", \"p10_ns\": " << p.p10_ns
+                << ", \"p90_ns\": " << p.p90_ns << ", \"mb_per_s\": " << p.bytes / (p.median_ns / 1000) << ", \"cycles_per_byte\": ";
+            if (std::isnan(p.cycles_per_byte))
+                std::cout << "null";
+            else
+                std::cout << p.cycles_per_byte;
+            std::cout << "}";
+        }
+        std::cout << "}}" << (i + 1 < results.size() ? "," : "") << std::endl;
+    }
+    std::cout << "]" << std::endl;
+}
+
+
+//
+// Command line
+//
+
+static std::vector<std::string> split(const std::string& list) {
+    std::vector<std::string> items;
+    size_t begin = 0;
+    for (size_t end; (end = list.find(',', begin)) != std::string::npos; begin = end + 1)
+        items.push_back(list.substr(begin, end - begin));
+    items.push_back(list.substr(begin));
+    return items;
+}
+
+static bool selected(const std::vector<std::string>& filter, const char* name) {
+    return filter.empty() || std::find(filter.begin(), filter.end(), name) != filter.end();
+}
+
+static int usage() {
+    std::cerr << "usage: rans-benchmark [-v variant,...] [-d source,...] [-n size,...|min..max] [-r repetitions] [-w warmup] [--json]" << std::endl
+        << "variants:";
+    for (const Variant& v : variants)
+        std::cerr << " " << v.name;
+    std::cerr << std::endl << "sources: geo:P zipf:S markov:S uniform enwiki mix:A+B+...@RUN file directory (default:";
+    for (const char* spec : default_sources)
+        std::cerr << " " << spec;
+    std::cerr << ")" << std::endl << "sizes: 256, 64K, 16M, 4G, ... or min..max by 4x, 0 for the size of the source" << std::endl;
+    return 2;
+}
+
+// the repetitions and warmup runs for an input of size bytes
+static BenchParams scaled_params(const BenchParams& params, size_t size) {
+    BenchParams scaled = params;
+    size_t runs = std::max<size_t>((size_t(1) << 30) / std::max<size_t>(size, 1), 3);
+    if (runs < (size_t)params.repetitions) {
+        scaled.repetitions = (int)runs;
+        scaled.warmup = std::min(params.warmup, 1);
+    }
+    return scaled;
+}
+
+int main(int argc, char** argv) {
+    BenchParams params;
+    std::vector<std::string> variant_filter, source_specs(std::begin(default_sources), std::end(default_sources));
+    bool json = false;
+    for (int arg = 1; arg < argc; arg++) {
+        std::string option = argv[arg];
+        if (option == "--json") {
+            json = true;
+            continue;
+        }
+        if (arg + 1 >= argc)
+            return usage();
+        std::string value = argv[++arg];
+        if (option == "-v")
+            variant_filter = split(value);
+        else if (option == "-d")
+            source_specs = split(value);
+        else if (option == "-n" && !parse_sizes(value, params.sizes))
+            return usage();
+        else if (option == "-r")
+            params.repetitions = std::max(1, std::stoi(value));
+        else if (option == "-w")
+            params.warmup = std::max(0, std::stoi(value));
+        else if (option != "-n")
+            return usage();
+    }
+    for (const std::string& name : variant_filter) {
+        if (std::none_of(std::begin(variants), std::end(variants), [&](const Variant& v) { return name == v.name; }))
+            return usage();
+    }
+    std::vector<std::unique_ptr<CorpusSource>> sources;
+    for (const std::string& spec : source_specs) {
+        std::string error;
+        auto opened = open_sources(spec, &error);
+        if (opened.empty()) {
+            std::cerr << error << std::endl;
+            return usage();
+        }
+        for (auto& source : opened)
+            sources.push_back(std::move(source));
+    }
+
+    // the kernels picked for this CPU, RANS_CPU selects a lower level
+    if (!json)
+        std::cout << "kernels: " << cpu_level_name(cpu_level()) << std::endl;
+    std::vector<Result> results;
+    bool ok = true;
+    for (const auto& source : sources) {
+        for (size_t size : params.sizes) {
+            size = size ? size : source->natural_size();
+            std::vector<const Variant*> runnable;
+            for (const Variant& variant : variants) {
+                if (!selected(variant_filter, variant.name))
+                    continue;
+                if (variant.make()->max_encoded_size(size) <= INT_MAX) {
+                    runnable.push_back(&variant);
+                } else if (!json) {
+                    print_names(source->name(), variant.name);
+                    std::cout << size << " skipped, the stream bound exceeds INT_MAX" << std::endl;
+                }
+            }
+            if (runnable.empty())
+                continue;
+
+            std::vector<uint8_t> sequence(size);
+            source->fill(sequence.data(), sequence.size());
+            BenchParams scaled = scaled_params(params, sequence.size());
+
+            // the histogram does not depend on the coder, the normalization depends on its precision
+            SymbolStats counted;
+            PhaseStats histogram = measure("histogram", sequence.size(), scaled, [&] { counted.count_freqs(sequence.data(), sequence.size()); });
+
+            for (const Variant* variant : runnable) {
+                results.push_back(bench_variant(*variant, source->name(), sequence, counted, histogram, scaled));
+                ok &= results.back().ok;
+                if (!json)
+                    print_text(results.back());
+            }
+        }
+    }
+    if (json)
+        print_json(results);
+    return ok ? 0 : 1;
+}
@@ -0,0 +1,540 @@
+#include <stdint.h>
+#include <string.h>
+#include <algorithm>
+#include <array>
+#include <chrono>
+#include <memory>
+#include <random>
+#include <vector>
+
+#include "block-container.h"
+#include "stream-header.h"
+
+static constexpr size_t FOOTER_SIZE = 16;
+static constexpr size_t MAX_INDEX_ENTRY_SIZE = 30;
+
+// the tables of one of the variants, built for the blocks with their own model
+struct BlockModel {
+    Rans64SequenceInfo rans;
+    RansFast64SequenceInfo fast;
+    SequenceInfo acc3;
+    SequenceInfo_2 acc2;
+};
+
+static bool is_bypass(const StreamHeader& header) {
+    return header.variant == STREAM_STORED || header.variant == STREAM_RLE;
+}
+
+// nothing for the stored and RLE blocks
+static void init_block_model(BlockModel& model, const StreamHeader& header) {
+    if (is_bypass(header))
+        return;
+    if (header.variant == STREAM_RANS64)
+        model.rans = init_rANS(header.stats);
+    else if (header.variant == STREAM_RANS64_FAST)
+        model.fast = init_rANS_fast(header.stats);
+    else if (header.accuracy_bits == 2)
+        model.acc2 = init_rANS_with_accuracy_2(header.stats);
+    else
+        model.acc3 = init_rANS_with_accuracy_3(header.stats);
+}
+
+template <typename Rans>
+static int encode_fixed_accuracy(std::span<const uint8_t> block, std::span<uint8_t> buf, const typename Rans::SequenceInfo& info, int ways) {
+    switch (ways) {
+    case 2: return Rans::template encode_interleaved<2>(block, buf, info.esyms);
+    case 4: return Rans::template encode_interleaved<4>(block, buf, info.esyms);
+    case 8: return Rans::template encode_interleaved<8>(block, buf, info.esyms);
+    default: return Rans::encode(block, buf, info.esyms);
+    }
+}
+
+template <typename Rans>
+static bool decode_fixed_accuracy(const typename Rans::SequenceInfo& info, int ways, const uint8_t* payload, const uint8_t* payload_end,
+    uint8_t* out, size_t size
+) {
+    const typename Rans::DecSymInfo* dsyms = info.dsyms.data();
+    const uint8_t* cum2sym = info.cum2sym.data();
+    switch (ways) {
+    case 2: return Rans::template decode_interleaved<2>(dsyms, cum2sym, payload, payload_end, out, out + size);
+    case 4: return Rans::template decode_interleaved<4>(dsyms, cum2sym, payload, payload_end, out, out + size);
+    case 8: return Rans::template decode_interleaved<8>(dsyms, cum2sym, payload, payload_end, out, out + size);
+    default: return Rans::decode(dsyms, cum2sym, payload, payload_end, out, out + size);
+    }
+}
+
+// the largest payload of a block of size bytes coded as in the header
+static size_t max_payload_size(const StreamHeader& header, size_t size) {
+    if (header.variant == STREAM_STORED)
+        return size;
+    if (header.variant == STREAM_RLE)
+        return 0;
+    if (header.variant == STREAM_RANS64 || header.variant == STREAM_RANS64_FAST)
+        return max_encoded_size_rANS(size);
+    if (header.accuracy_bits == 2)
+        return RansWithAccuracy2::max_encoded_size(size, header.ways);
+    return RansWithAccuracy3::max_encoded_size(size, header.ways);
+}
+
+// a block is coded into a slot: the stream header at its start, the payload from SLOT_HEADER_SIZE on (8-aligned)
+static constexpr size_t SLOT_HEADER_SIZE = (MAX_STREAM_HEADER_SIZE + 7) & ~size_t(7);
+
+static size_t slot_size(size_t max_payload_size) {
+    return SLOT_HEADER_SIZE + ((max_payload_size + 7) & ~size_t(7));
+}
+
+// the coded block: header_size bytes of the stream header followed by the header.encoded_size bytes of the payload,
+// which is in the slot or, for stored blocks, the input itself
+struct CodedBlock {
+    const uint8_t* header;
+    size_t header_size;
+    const uint8_t* payload;
+};
+
+// codes the block into slot, which holds slot_size(max_payload_size(header, size)) bytes and is 8-aligned; the stream
+// header is written only for the blocks with their own model
+static CodedBlock encode_block_payload(const uint8_t* in, StreamHeader& header, bool own_model, const BlockModel& model, uint8_t* slot) {
+    std::span<const uint8_t> block(in, header.original_size);
+    // the 64-bit rANS writes 32-bit words back from the end, its bound is a multiple of 4
+    std::span<uint8_t> buf(slot + SLOT_HEADER_SIZE, is_bypass(header) ? 0 : max_payload_size(header, header.original_size));
+    const uint8_t* payload = buf.data();
+    if (header.variant == STREAM_STORED) {
+        header.encoded_size = header.original_size;
+        payload = in;
+    } else if (header.variant == STREAM_RLE) {
+        header.encoded_size = 0;
+    } else if (header.variant == STREAM_RANS64) {
+        header.encoded_size = encode_rANS(block, buf, model.rans.esyms);
+        payload = buf.data() + buf.size() - header.encoded_size;
+    } else if (header.variant == STREAM_RANS64_FAST) {
+        header.encoded_size = encode_rANS_fast(block, buf, model.fast.esyms);
+        payload = buf.data() + buf.size() - header.encoded_size;
+    } else if (header.accuracy_bits == 2) {
+        header.encoded_size = encode_fixed_accuracy<RansWithAccuracy2>(block, buf, model.acc2, header.ways);
+    } else {
+        header.encoded_size = encode_fixed_accuracy<RansWithAccuracy3>(block, buf, model.acc3, header.ways);
+    }
+    return { slot, own_model ? write_stream_header(header, slot) : 0, payload };
+}
+
+static void set_coder(StreamHeader& header, const CoderCandidate& coder) {
+    header.variant = coder.variant;
+    header.accuracy_bits = coder.accuracy_bits;
+    header.ways = coder.ways;
+}
+
+// the coder chosen for the block with header.stats normalized from counts
+static void select_block_coder(StreamHeader& header, const uint32_t* counts, const ContainerParams& params) {
+    set_coder(header, select_coder(header.stats, counts, header.original_size, params.select).coder);
+}
+
+// a single run for the blocks of one symbol, stored bytes when the payload with the frequency table and the
+// final state would not be shorter; needs the stats normalized from counts but no tables
+static bool select_bypass(StreamHeader& header, const uint32_t* counts) {
+    if (header.original_size == 0)
+        return false;
+    if (std::count_if(counts, counts + 256, [](uint32_t count) { return count != 0; }) == 1) {
+        set_coder(header, { STREAM_RLE, 0, 1 });
+        return true;
+    }
+    uint8_t table[MAX_FREQ_TABLE_SIZE];
+    double coded_bits = header.stats.code_length(counts) + 8.0 * (write_freq_table(header.stats.freqs, table) - table + 8);
+    if (coded_bits < 8.0 * header.original_size)
+        return false;
+    set_coder(header, { STREAM_STORED, 0, 1 });
+    return true;
+}
+
+bool supported_container_params(const ContainerParams& params) {
+    if (params.variant == STREAM_FIXED_ACCURACY) {
+        return (params.accuracy_bits == 2 || params.accuracy_bits == 3)
+            && (params.ways == 1 || params.ways == 2 || params.ways == 4 || params.ways == 8);
+    }
+    return params.variant == STREAM_RANS64 || params.variant == STREAM_RANS64_FAST || params.variant == STREAM_STORED;
+}
+
+// params must be supported
+static StreamHeader block_header_proto(const ContainerParams& params) {
+    bool fixed_accuracy = params.variant == STREAM_FIXED_ACCURACY;
+    return {
+        .variant = params.variant,
+        .prob_bits = 14,
+        .accuracy_bits = (uint8_t)(fixed_accuracy ? params.accuracy_bits : 0),
+        .ways = (uint8_t)(fixed_accuracy ? params.ways : 1),
+        .original_size = 0,
+        .encoded_size = 0,
+        .stats = {}
+    };
+}
+
+bool encode_block(const uint8_t* in, size_t size, const ContainerParams& params, std::vector<uint8_t>& out) {
+    if (!supported_container_params(params)) {
+        out.clear();
+        return false;
+    }
+    StreamHeader header = block_header_proto(params);
+    header.original_size = size;
+    header.stats.count_freqs(in, size);
+    uint32_t counts[256];
+    std::copy(header.stats.freqs, header.stats.freqs + 256, counts);
+    header.stats.normalize_freqs(1 << 14);
+    if (!(params.bypass_modes && select_bypass(header, counts)) && params.select_coders)
+        select_block_coder(header, counts, params);
+    BlockModel model;
+    init_block_model(model, header);
+    std::vector<uint64_t> slot(slot_size(max_payload_size(header, size)) / 8);
+    CodedBlock coded = encode_block_payload(in, header, true, model, (uint8_t*)slot.data());
+    out.reserve(coded.header_size + header.encoded_size);
+    out.assign(coded.header, coded.header + coded.header_size);
+    out.insert(out.end(), coded.payload, coded.payload + header.encoded_size);
+    return true;
+}
+
+// the largest payload of a block of size bytes by any coder the parameters allow
+static size_t max_block_payload_size(const ContainerParams& params, size_t size) {
+    StreamHeader header = block_header_proto(params);
+    if (!params.select_coders)
+        return max_payload_size(header, size);
+    size_t max_size = 0;
+    for (const CoderCandidate& coder : CODER_CANDIDATES) {
+        set_coder(header, coder);
+        max_size = std::max(max_size, max_payload_size(header, size));
+    }
+    return max_size;
+}
+
+size_t max_container_size(size_t size, const ContainerParams& params) {
+    size_t block_size = std::max<size_t>(params.block_size, 1);
+    size_t block_count = (size + block_size - 1) / block_size;
+    if (block_count == 0)
+        return FOOTER_SIZE;
+    size_t last_size = size - (block_count - 1) * block_size;
+    size_t payload_size = (block_count - 1) * max_block_payload_size(params, block_size) + max_block_payload_size(params, last_size);
+    return payload_size + block_count * (MAX_STREAM_HEADER_SIZE + MAX_INDEX_ENTRY_SIZE) + FOOTER_SIZE;
+}
+
+size_t encode_container(const uint8_t* in, size_t size, const ContainerParams& params, uint8_t* out, size_t capacity, ThreadPool* pool) {
+    if (!supported_container_params(params))
+        return 0;
+    ThreadPool serial(1);
+    if (!pool)
+        pool = &serial;
+
+    size_t block_size = std::max<size_t>(params.block_size, 1);
+    size_t block_count = (size + block_size - 1) / block_size;
+    StreamHeader proto = block_header_proto(params);
+
+    // the blocks go through the pool in batches, so only the tables and the outputs of a batch are kept; every block
+    // is coded into its slot of the batch and copied once into out, at an offset known only when the blocks before
+    // it are coded
+    size_t batch_size = pool->size() * 4;
+    size_t block_slot_size = slot_size(max_block_payload_size(params, block_size));
+    std::vector<StreamHeader> headers(batch_size, proto);
+    std::vector<double> own_bits(batch_size);
+    std::vector<std::array<uint32_t, 256>> counts(batch_size);
+    std::vector<uint32_t> model_blocks(batch_size);
+    std::vector<BlockModel> models(batch_size);
+    std::vector<uint64_t> slots(batch_size * block_slot_size / 8);
+    std::vector<CodedBlock> coded(batch_size);
+    std::vector<uint64_t> offsets(batch_size);
+
+    // the model of the last block with its own one, blocks of the next batches may reuse it
+    StreamHeader last_model_header;
+    BlockModel last_model;
+    uint32_t last_model_block = 0;
+    bool have_model = false;
+
+    std::vector<uint8_t> index;
+    uint64_t offset = 0;
+    for (size_t first = 0; first < block_count; first += batch_size) {
+        size_t count = std::min(batch_size, block_count - first);
+
+        pool->parallel_for(count, [&](size_t k) {
+            size_t i = first + k;
+            StreamHeader& header = headers[k];
+            set_coder(header, { proto.variant, proto.accuracy_bits, proto.ways });     // the previous batch may have changed it
+            header.original_size = std::min(block_size, size - i * block_size);
+            header.stats.count_freqs(in + i * block_size, header.original_size);
+            std::copy(header.stats.freqs, header.stats.freqs + 256, counts[k].begin());
+            header.stats.normalize_freqs(1 << 14);
+            if (!(params.bypass_modes && select_bypass(header, counts[k].data())) && params.select_coders)
+                select_block_coder(header, counts[k].data(), params);
+            if (params.share_models) {
+                // the encoded size does not matter for the header length estimate up to a couple of bytes
+                uint8_t header_buf[MAX_STREAM_HEADER_SIZE];
+                header.encoded_size = header.original_size;
+                own_bits[k] = header.stats.code_length(counts[k].data()) + 8.0 * write_stream_header(header, header_buf);
+            }
+        });
+
+        // a block reuses the last model when it codes the block shorter than its own one with the header,
+        // it is coded by the coder of the model then; the stored and RLE blocks have no tables to share
+        for (size_t k = 0; k < count; k++) {
+            size_t i = first + k;
+            const StreamHeader& prev_header = last_model_block >= first ? headers[last_model_block - first] : last_model_header;
+            bool bypass = is_bypass(headers[k]);
+            bool shared = params.share_models && have_model && !bypass && prev_header.stats.code_length(counts[k].data()) <= own_bits[k];
+            model_blocks[k] = shared ? last_model_block : (uint32_t)i;
+            if (shared) {
+                set_coder(headers[k], { prev_header.variant, prev_header.accuracy_bits, prev_header.ways });
+            } else if (!bypass) {
+                last_model_block = (uint32_t)i;
+                have_model = true;
+            }
+        }
+
+        pool->parallel_for(count, [&](size_t k) {
+            if (model_blocks[k] == first + k)
+                init_block_model(models[k], headers[k]);
+        });
+        pool->parallel_for(count, [&](size_t k) {
+            uint32_t m = model_blocks[k];
+            const BlockModel& model = m >= first ? models[m - first] : last_model;
+            uint8_t* slot = (uint8_t*)slots.data() + k * block_slot_size;
+            coded[k] = encode_block_payload(in + (first + k) * block_size, headers[k], m == first + k, model, slot);
+        });
+
+        for (size_t k = 0; k < count; k++) {
+            uint8_t entry[MAX_INDEX_ENTRY_SIZE];
+            uint64_t compressed_size = coded[k].header_size + headers[k].encoded_size;
+            uint8_t* ptr = put_varint(entry, compressed_size);
+            ptr = put_varint(ptr, headers[k].original_size);
+            ptr = put_varint(ptr, first + k - model_blocks[k]);
+            index.insert(index.end(), entry, ptr);
+            offsets[k] = offset;
+            offset += compressed_size;
+        }
+        if (offset > capacity)
+            return 0;
+        pool->parallel_for(count, [&](size_t k) {
+            memcpy(out + offsets[k], coded[k].header, coded[k].header_size);
+            memcpy(out + offsets[k] + coded[k].header_size, coded[k].payload, headers[k].encoded_size);
+        });
+
+        if (have_model && last_model_block >= first) {
+            last_model_header = headers[last_model_block - first];
+            last_model = std::move(models[last_model_block - first]);
+        }
+    }
+
+    uint64_t index_offset = offset;
+    if (capacity - offset < index.size() + FOOTER_SIZE)
+        return 0;
+    uint8_t* footer = out + index_offset + index.size();
+    uint32_t block_count_32 = (uint32_t)block_count;
+    if (!index.empty())
+        memcpy(out + index_offset, index.data(), index.size());
+    memcpy(footer, &index_offset, 8);
+    memcpy(footer + 8, &block_count_32, 4);
+    memcpy(footer + 12, &CONTAINER_MAGIC, 4);
+    return index_offset + index.size() + FOOTER_SIZE;
+}
+
+std::vector<uint8_t> encode_container(const uint8_t* in, size_t size, const ContainerParams& params, ThreadPool* pool) {
+    if (!supported_container_params(params))
+        return {};
+    std::vector<uint8_t> out(max_container_size(size, params));
+    out.resize(encode_container(in, size, params, out.data(), out.size(), pool));
+    return out;
+}
+
+template <typename Fn>
+static double median_ns(int reps, Fn fn) {
+    using namespace std::chrono;
+    std::vector<double> times(std::max(reps, 1));
+    for (double& time : times) {
+        auto t1 = high_resolution_clock::now();
+        fn();
+        auto t2 = high_resolution_clock::now();
+        time = (double)duration_cast<nanoseconds>(t2 - t1).count();
+    }
+    std::nth_element(times.begin(), times.begin() + times.size() / 2, times.end());
+    return times[times.size() / 2];
+}
+
+CoderCostModel measure_coder_costs(size_t block_size, int reps) {
+    block_size = std::max<size_t>(block_size, 1);
+    std::default_random_engine gen;
+    std::geometric_distribution<int> skewed(0.5);
+    std::uniform_int_distribution<int> uniform(0, 255);
+    std::vector<uint8_t> blocks[2] = { std::vector<uint8_t>(block_size), std::vector<uint8_t>(block_size) };
+    for (size_t i = 0; i < block_size; i++) {
+        blocks[0][i] = (uint8_t)std::min(skewed(gen), 255);
+        blocks[1][i] = (uint8_t)uniform(gen);
+    }
+
+    CoderCostModel model;
+    std::vector<uint8_t> decoded(block_size);
+    for (const CoderCandidate& coder : CODER_CANDIDATES) {
+        // per block: bits per symbol of the model, encoding and decoding time per symbol
+        double bits[2], encode_ns[2], decode_ns[2], init_ns = 0;
+        for (int b = 0; b < 2; b++) {
+            StreamHeader header = { .variant = coder.variant, .prob_bits = 14, .accuracy_bits = coder.accuracy_bits, .ways = coder.ways,
+                .original_size = block_size, .encoded_size = 0, .stats = {} };
+            header.stats.count_freqs(blocks[b].data(), block_size);
+            uint32_t counts[256];
+            std::copy(header.stats.freqs, header.stats.freqs + 256, counts);
+            header.stats.normalize_freqs(1 << 14);
+            double code_length = header.stats.code_length(counts);
+
+            BlockModel block_model;
+            init_ns += median_ns(reps, [&] { init_block_model(block_model, header); }) / 2;
+            std::vector<uint64_t> slot(slot_size(max_payload_size(header, block_size)) / 8);
+            CodedBlock coded = {};
+            encode_ns[b] = median_ns(reps, [&] { coded = encode_block_payload(blocks[b].data(), header, false, block_model, (uint8_t*)slot.data()); }) / block_size;
+            const uint8_t* payload_end = coded.payload + header.encoded_size;
+            BlockDecoder decoder;
+            decoder.decode(header, coded.payload, payload_end, decoded.data(), block_size);     // builds the tables
+            decode_ns[b] = median_ns(reps, [&] {
+                decoder.decode(header, coded.payload, payload_end, decoded.data(), block_size);
+            }) / block_size;
+            bits[b] = code_length / block_size;
+        }
+
+        double encode_ns_per_bit = (encode_ns[1] - encode_ns[0]) / (bits[1] - bits[0]);
+        double decode_ns_per_bit = (decode_ns[1] - decode_ns[0]) / (bits[1] - bits[0]);
+        model.coders.push_back({
+            .coder = coder,
+            .init_ns = init_ns,
+            .encode_ns_per_symbol = encode_ns[0] - encode_ns_per_bit * bits[0],
+            .encode_ns_per_bit = encode_ns_per_bit,
+            .decode_ns_per_symbol = decode_ns[0] - decode_ns_per_bit * bits[0],
+            .decode_ns_per_bit = decode_ns_per_bit
+        });
+    }
+    return model;
+}
+
+bool ContainerReader::open(const uint8_t* container, size_t size) {
+    blocks.clear();
+    data = container;
+    if (size < FOOTER_SIZE)
+        return false;
+
+    uint64_t index_offset;
+    uint32_t block_count, magic;
+    const uint8_t* footer = container + size - FOOTER_SIZE;
+    memcpy(&index_offset, footer, 8);
+    memcpy(&block_count, footer + 8, 4);
+    memcpy(&magic, footer + 12, 4);
+    if (magic != CONTAINER_MAGIC || index_offset > size - FOOTER_SIZE || block_count > size)
+        return false;
+
+    const uint8_t* ptr = container + index_offset;
+    blocks.reserve(block_count);
+    uint64_t offset = 0, original_offset = 0;
+    for (uint32_t i = 0; i < block_count; i++) {
+        uint64_t compressed_size, original_size, model_distance;
+        if (!(ptr = get_varint(ptr, footer, compressed_size)) || !(ptr = get_varint(ptr, footer, original_size))
+            || !(ptr = get_varint(ptr, footer, model_distance)))
+            return false;
+        if (compressed_size > index_offset - offset || model_distance > i
+            || (model_distance && blocks[i - model_distance].model_block != i - model_distance))
+            return false;
+        blocks.push_back({ offset, compressed_size, original_offset, original_size, (uint32_t)(i - model_distance) });
+        offset += compressed_size;
+        original_offset += original_size;
+    }
+    return ptr == footer;
+}
+
+size_t ContainerReader::find_block(uint64_t original_offset) const {
+    auto it = std::upper_bound(blocks.begin(), blocks.end(), original_offset,
+        [](uint64_t offset, const ContainerBlock& block) { return offset < block.original_offset; });
+    return it == blocks.begin() ? 0 : it - blocks.begin() - 1;
+}
+
+bool BlockDecoder::decode(const StreamHeader& model, const uint8_t* payload, const uint8_t* payload_end, uint8_t* out, size_t original_size) {
+    if (model.variant == STREAM_STORED) {
+        if ((size_t)(payload_end - payload) != original_size)
+            return false;
+        if (original_size)
+            memcpy(out, payload, original_size);
+        return true;
+    }
+    if (model.variant == STREAM_RLE) {
+        const uint32_t* freqs = model.stats.freqs;
+        const uint32_t* symbol = std::find(freqs, freqs + 256, 1u << model.prob_bits);
+        if (payload != payload_end || (original_size && symbol == freqs + 256))
+            return false;
+        memset(out, (int)(symbol - freqs), original_size);
+        return true;
+    }
+    if (model.prob_bits != 14 || model.variant == STREAM_RANS_AVX2
+        || (model.variant == STREAM_FIXED_ACCURACY && model.accuracy_bits != 2 && model.accuracy_bits != 3))
+        return false;
+    if (original_size == 0)
+        return true;
+    if (payload_end - payload < 4)
+        return false;
+
+    // the 64-bit rANS decoders read aligned 32-bit words
+    std::vector<uint32_t> aligned;
+    if (model.variant != STREAM_FIXED_ACCURACY && (uintptr_t)payload % 4 != 0) {
+        aligned.resize((payload_end - payload + 3) / 4);
+        memcpy(aligned.data(), payload, payload_end - payload);
+        payload_end = (const uint8_t*)aligned.data() + (payload_end - payload);
+        payload = (const uint8_t*)aligned.data();
+    }
+    // every decoder stays inside the payload and fails when it runs out before original_size symbols
+    if (model.variant == STREAM_RANS64) {
+        auto info = rans_tables.get(model.stats);
+        return decode_rANS(info->dsyms, info->cum2sym, payload, payload_end, out, original_size);
+    }
+    if (model.variant == STREAM_RANS64_FAST) {
+        auto info = fast_tables.get(model.stats);
+        return decode_rANS_fast(info->dsyms, info->cum2sym, payload, payload_end, out, original_size);
+    }
+    if (model.accuracy_bits == 2)
+        return decode_fixed_accuracy<RansWithAccuracy2>(*acc2_tables.get(model.stats), model.ways, payload, payload_end, out, original_size);
+    return decode_fixed_accuracy<RansWithAccuracy3>(*acc3_tables.get(model.stats), model.ways, payload, payload_end, out, original_size);
+}
+
+bool ContainerReader::decode_block(size_t i, uint8_t* out) {
+    if (i >= blocks.size())
+        return false;
+    const ContainerBlock& b = blocks[i];
+    const ContainerBlock& m = blocks[b.model_block];
+
+    StreamHeader header;
+    size_t header_size = read_stream_header(data + m.offset, m.compressed_size, header);
+    if (!header_size)
+        return false;
+    if (&b == &m && (header.original_size != b.original_size || header.encoded_size != b.compressed_size - header_size))
+        return false;
+
+    size_t payload_offset = b.offset + (&b == &m ? header_size : 0);
+    return decoder.decode(header, data + payload_offset, data + b.offset + b.compressed_size, out, b.original_size);
+}
+
+bool ContainerReader::read(uint64_t original_offset, size_t size, uint8_t* out, ThreadPool* pool) {
+    if (original_offset > original_size() || size > original_size() - original_offset)
+        return false;
+    if (size == 0)
+        return true;
+
+    // the blocks covered entirely are decoded in place, the ones at the ends of the range through a buffer
+    size_t first = find_block(original_offset);
+    size_t last = find_block(original_offset + size - 1);
+    std::vector<char> ok(last - first + 1);
+    auto decode = [&](size_t k) {
+        const ContainerBlock& b = blocks[first + k];
+        uint64_t begin = std::max(b.original_offset, original_offset);
+        uint64_t end = std::min(b.original_offset + b.original_size, original_offset + size);
+        uint8_t* dst = out + (begin - original_offset);
+        if (begin == b.original_offset && end == b.original_offset + b.original_size) {
+            ok[k] = decode_block(first + k, dst);
+        } else {
+            std::vector<uint8_t> scratch(b.original_size);
+            ok[k] = decode_block(first + k, scratch.data());
+            memcpy(dst, scratch.data() + (begin - b.original_offset), end - begin);
+        }
+    };
+    if (pool) {
+        pool->parallel_for(ok.size(), decode);
+    } else {
+        for (size_t k = 0; k < ok.size(); k++)
+            decode(k);
+    }
+    return std::all_of(ok.begin(), ok.end(), [](char block_ok) { return block_ok; });
+}
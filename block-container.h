@@ -0,0 +1,110 @@
+//
+// Container of independently coded blocks with a trailing index, so that any block (or any byte range) can be
+// decoded without the preceding ones. The blocks are coded by one of the rANS variants with 14 probability bits:
+// ryg's rANS, the fast rANS or the fixed-accuracy rANS with the accuracy 3 or 2 and 1, 2, 4 or 8 ways, either
+// fixed by the parameters or chosen for every block with its own model by select_coder (coder-select.h).
+// Blocks that coding would not shrink are stored and blocks of a single symbol are one run (bypass_modes),
+// decided from the counts before any table is built.
+//
+// block:   stream header (stream-header.h) + payload, or only the payload if the block reuses the model
+//          of an earlier block
+// index:   per block varint compressed_size, varint original_size, varint distance to the block with the model
+//          (0 for the blocks with their own model)
+// footer:  uint64 index offset, uint32 number of blocks, uint32 CONTAINER_MAGIC
+//
+
+#pragma once
+
+#include <vector>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "rans.h"
+#include "rans-fast.h"
+#include "rans-fixed-accuracy.h"
+#include "coder-select.h"
+#include "stream-header.h"
+#include "table-cache.h"
+#include "thread-pool.h"
+
+static constexpr uint32_t CONTAINER_MAGIC = 0x58444952;    // "RIDX"
+
+struct ContainerParams {
+    size_t block_size = 1 << 16;
+    StreamVariant variant = STREAM_FIXED_ACCURACY;     // STREAM_RANS_AVX2 and STREAM_RLE are rejected
+    int accuracy_bits = 3;          // 3 or 2 for STREAM_FIXED_ACCURACY
+    int ways = 4;                   // interleaved states of STREAM_FIXED_ACCURACY: 1, 2, 4 or 8
+    bool share_models = true;       // reuse the previous model when it codes the block shorter than its own with the header
+    bool select_coders = false;     // choose variant, accuracy_bits and ways for every block with its own model
+    bool bypass_modes = true;       // STREAM_STORED and STREAM_RLE blocks, they never share models
+    SelectParams select = {};       // the objective of select_coders
+};
+
+struct ContainerBlock {
+    uint64_t offset;            // in the container
+    uint64_t compressed_size;
+    uint64_t original_offset;
+    uint64_t original_size;
+    uint32_t model_block;       // the block holding the stream header with the model
+};
+
+// false for the variants the container does not produce and for accuracy_bits or ways out of their ranges
+bool supported_container_params(const ContainerParams& params);
+
+// the blocks are counted, modeled, encoded and copied into the container on the pool if it is set; empty if the
+// parameters are not supported (an empty input still gives the footer)
+std::vector<uint8_t> encode_container(const uint8_t* in, size_t size, const ContainerParams& params = {}, ThreadPool* pool = nullptr);
+// writes the container to out (e.g. a mapped file), returns its size or 0 if it does not fit the capacity or the
+// parameters are not supported
+size_t encode_container(const uint8_t* in, size_t size, const ContainerParams& params, uint8_t* out, size_t capacity, ThreadPool* pool = nullptr);
+// a capacity always enough for encode_container with supported parameters
+size_t max_container_size(size_t size, const ContainerParams& params);
+
+// a single block with its own stream header (share_models and block_size are ignored); false and out is empty
+// if the parameters are not supported
+bool encode_block(const uint8_t* in, size_t size, const ContainerParams& params, std::vector<uint8_t>& out);
+
+// the costs of the candidates of select_coder timed through the container on this machine, on a skewed and a
+// uniform block of block_size bytes (median of reps runs)
+CoderCostModel measure_coder_costs(size_t block_size = 1 << 16, int reps = 9);
+
+// decodes the payloads of the blocks with the tables of their models kept in TableCaches; may be used from several threads
+class BlockDecoder {
+public:
+    BlockDecoder() : rans_tables(init_rANS), fast_tables(init_rANS_fast), acc3_tables(RansWithAccuracy3::init), acc2_tables(RansWithAccuracy2::init) {}
+
+    // false for the variants and parameters the container does not produce and for a payload that runs out before
+    // original_size bytes or is not used up there, nothing outside it is read; out holds original_size bytes
+    bool decode(const StreamHeader& model, const uint8_t* payload, const uint8_t* payload_end, uint8_t* out, size_t original_size);
+
+private:
+    TableCache<Rans64SequenceInfo> rans_tables;
+    TableCache<RansFast64SequenceInfo> fast_tables;
+    TableCache<SequenceInfo> acc3_tables;
+    TableCache<SequenceInfo_2> acc2_tables;
+};
+
+// decode_block and read may be called from several threads
+class ContainerReader {
+public:
+    // parses the index, false if the container is malformed; a payload that does not match its entry fails
+    // decode_block instead, which reads nothing outside the payload;
+    // data must stay alive while the reader is used
+    bool open(const uint8_t* data, size_t size);
+
+    size_t block_count() const { return blocks.size(); }
+    const ContainerBlock& block(size_t i) const { return blocks[i]; }
+    uint64_t original_size() const { return blocks.empty() ? 0 : blocks.back().original_offset + blocks.back().original_size; }
+    // the block containing the original byte at original_offset
+    size_t find_block(uint64_t original_offset) const;
+
+    // out holds block(i).original_size bytes
+    bool decode_block(size_t i, uint8_t* out);
+    // decodes only the blocks overlapping [original_offset, original_offset + size), on the pool if it is set
+    bool read(uint64_t original_offset, size_t size, uint8_t* out, ThreadPool* pool = nullptr);
+
+private:
+    const uint8_t* data = nullptr;
+    std::vector<ContainerBlock> blocks;
+    BlockDecoder decoder;
+};
@@ -0,0 +1,85 @@
+#include <stdint.h>
+#include <algorithm>
+#include <bit>
+#include <cmath>
+#include <limits>
+#include <numeric>
+
+#include "coder-select.h"
+
+// the final states in bits: one 64-bit state of ryg's and the fast rANS; the fixed-accuracy coders emit prob_bits +
+// accuracy_bits + 1 bits for every state but the last one, which goes into a 32-bit word together with the last
+// 0-7 bits of the stream (already in the code length, 3.5 on average)
+static double flush_bits(const CoderCandidate& coder, int prob_bits) {
+    if (coder.variant != STREAM_FIXED_ACCURACY)
+        return 64;
+    return (coder.ways - 1) * (prob_bits + coder.accuracy_bits + 1) + 32 - 3.5;
+}
+
+const CoderCostModel& default_coder_costs() {
+    static const CoderCostModel model = { {
+        //  coder                              init  encode/symbol  /bit  decode/symbol  /bit
+        { { STREAM_RANS64, 0, 1 },             2560, 8.05,  -0.076,      7.67,  -0.087 },
+        { { STREAM_RANS64_FAST, 0, 1 },        4270, 4.24,  -0.100,      7.63,  -0.071 },
+        { { STREAM_FIXED_ACCURACY, 3, 1 },     2570, 7.36,  -0.001,      10.24, -0.080 },
+        { { STREAM_FIXED_ACCURACY, 3, 2 },     2606, 9.09,  0.009,       6.96,  -0.121 },
+        { { STREAM_FIXED_ACCURACY, 3, 4 },     2485, 8.44,  0.006,       4.58,  -0.140 },
+        { { STREAM_FIXED_ACCURACY, 3, 8 },     2540, 6.59,  0,           4.63,  -0.163 },
+        { { STREAM_FIXED_ACCURACY, 2, 1 },     2578, 6.65,  0.005,       9.82,  -0.076 },
+        { { STREAM_FIXED_ACCURACY, 2, 2 },     2534, 8.27,  0.011,       6.69,  -0.118 },
+        { { STREAM_FIXED_ACCURACY, 2, 4 },     2676, 6.02,  0.133,       4.61,  -0.142 },
+        { { STREAM_FIXED_ACCURACY, 2, 8 },     2598, 5.55,  0.009,       4.43,  -0.136 },
+    } };
+    return model;
+}
+
+// The fixed-accuracy encoder turns the state x in [f << a, f << (a + 1)) of a symbol with the frequency f, the
+// cumulative frequency c and accuracy_bits a into q * M + c + r (q = x / f, r = x % f, M the total), where the
+// exact coder would reach x * M / f. The relative difference is d / q with d = (c + r - r * M / f) / M; the
+// first-order terms cancel over the symbols and, with q distributed as 1 / q on [2^a, 2^(a + 1)), the second-order
+// term costs E[d^2] * 3 / (16 ln(2)^2) / 4^a bits per symbol. That is within 10% of the coder on most statistics
+// and overestimates the loss of power-of-two frequencies.
+double accuracy_loss(const SymbolStats& stats, const uint32_t* counts, int accuracy_bits) {
+    if (!accuracy_bits)
+        return 0;
+    double total = std::accumulate(stats.freqs, stats.freqs + 256, 0.0), cum = 0, loss = 0;
+    for (int s = 0; s < 256; s++) {
+        double c = cum / total, p = stats.freqs[s] / total;
+        loss += counts[s] * (c * c - c * (1 - p) + (1 - p) * (1 - p) / 3);     // E[d^2] with r / f uniform
+        cum += stats.freqs[s];
+    }
+    return loss * 3 / (16 * std::log(2) * std::log(2)) / (1 << 2 * accuracy_bits);
+}
+
+CoderEstimate estimate_coder(const CoderCosts& costs, double payload_bits, size_t size, int prob_bits, double decode_weight) {
+    double bits_per_symbol = size ? payload_bits / size : 0;
+    double encode_ns = std::max(costs.encode_ns_per_symbol + costs.encode_ns_per_bit * bits_per_symbol, 0.0);
+    double decode_ns = std::max(costs.decode_ns_per_symbol + costs.decode_ns_per_bit * bits_per_symbol, 0.0);
+    return {
+        .coder = costs.coder,
+        .bits = payload_bits + flush_bits(costs.coder, prob_bits),
+        .ns = costs.init_ns * (1 + decode_weight) + size * (encode_ns + decode_weight * decode_ns)
+    };
+}
+
+CoderEstimate select_coder(const SymbolStats& stats, const uint32_t* counts, size_t size, const SelectParams& params) {
+    const CoderCostModel& model = params.costs ? *params.costs : default_coder_costs();
+    double code_length = stats.code_length(counts);
+    int prob_bits = std::bit_width(std::accumulate(stats.freqs, stats.freqs + 256, 0u)) - 1;
+
+    CoderEstimate best = { .coder = CODER_CANDIDATES[0], .bits = 0, .ns = 0 };
+    double best_cost = std::numeric_limits<double>::infinity(), best_ns = best_cost;
+    for (const CoderCosts& costs : model.coders) {
+        double payload_bits = code_length + accuracy_loss(stats, counts, costs.coder.accuracy_bits);
+        CoderEstimate estimate = estimate_coder(costs, payload_bits, size, prob_bits, params.decode_weight);
+        double cost = params.goal == SELECT_MIN_SIZE ? estimate.bits
+            : params.goal == SELECT_MAX_SPEED ? estimate.ns
+            : estimate.ns + params.ns_per_byte * estimate.bits / 8;
+        if (cost < best_cost || (cost == best_cost && estimate.ns < best_ns)) {
+            best = estimate;
+            best_cost = cost;
+            best_ns = estimate.ns;
+        }
+    }
+    return best;
+}
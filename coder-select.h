@@ -0,0 +1,73 @@
+//
+// Choice of the coder of a block by a cost model. Every candidate (ryg's rANS, the fast rANS and the accuracy 3
+// and 2 coders with 1, 2, 4 or 8 ways) has measured costs: the table build and the encoding and decoding time per
+// symbol as a linear function of the bits per symbol. The coded size of a block is estimated from the code length
+// of its counts by its normalized statistics, the bits the fixed-accuracy coders lose on them and the final states,
+// and the candidate with the lowest cost for the objective goes into the stream header of the block.
+//
+
+#pragma once
+
+#include <vector>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "stream-header.h"
+#include "sym-stats.h"
+
+struct CoderCandidate {
+    StreamVariant variant;
+    uint8_t accuracy_bits;      // 0 for ryg's and the fast rANS
+    uint8_t ways;
+};
+
+static constexpr CoderCandidate CODER_CANDIDATES[] = {
+    { STREAM_RANS64, 0, 1 }, { STREAM_RANS64_FAST, 0, 1 },
+    { STREAM_FIXED_ACCURACY, 3, 1 }, { STREAM_FIXED_ACCURACY, 3, 2 }, { STREAM_FIXED_ACCURACY, 3, 4 }, { STREAM_FIXED_ACCURACY, 3, 8 },
+    { STREAM_FIXED_ACCURACY, 2, 1 }, { STREAM_FIXED_ACCURACY, 2, 2 }, { STREAM_FIXED_ACCURACY, 2, 4 }, { STREAM_FIXED_ACCURACY, 2, 8 }
+};
+
+// the time of a candidate in nanoseconds, per symbol it is ns_per_symbol + ns_per_bit * bits per symbol
+struct CoderCosts {
+    CoderCandidate coder;
+    double init_ns;                 // the table build, paid by the encoder and again by the decoder
+    double encode_ns_per_symbol;
+    double encode_ns_per_bit;
+    double decode_ns_per_symbol;
+    double decode_ns_per_bit;
+};
+
+struct CoderCostModel {
+    std::vector<CoderCosts> coders;
+};
+
+enum SelectGoal : uint8_t {
+    SELECT_MIN_SIZE,        // the shortest output, the time breaks ties
+    SELECT_MAX_SPEED,       // the shortest encoding and decoding time
+    SELECT_WEIGHTED         // the shortest time with every output byte worth ns_per_byte
+};
+
+struct SelectParams {
+    SelectGoal goal = SELECT_WEIGHTED;
+    double ns_per_byte = 2.0;               // the time of storing or sending a byte, 2 ns at 500 MB/s
+    double decode_weight = 1.0;             // decodings per encoding, 0 if only the encoding speed matters
+    const CoderCostModel* costs = nullptr;  // default_coder_costs() if null
+};
+
+struct CoderEstimate {
+    CoderCandidate coder;
+    double bits;            // the payload
+    double ns;              // table builds, encoding and decode_weight decodings
+};
+
+// the costs of the candidates measured on the x86-64 machine of the README benchmarks by measure_coder_costs
+// (block-container.h), the same on every host so that the choice is reproducible
+const CoderCostModel& default_coder_costs();
+
+// the bits the coders with accuracy_bits lose against stats.code_length(counts), 0 for accuracy_bits = 0
+double accuracy_loss(const SymbolStats& stats, const uint32_t* counts, int accuracy_bits);
+// the size and time of coding size symbols in payload_bits (the code length with the accuracy loss) by stats
+// normalized to 1 << prob_bits
+CoderEstimate estimate_coder(const CoderCosts& costs, double payload_bits, size_t size, int prob_bits, double decode_weight = 1.0);
+// the best candidate for a block of size symbols with the given counts and stats normalized from them
+CoderEstimate select_coder(const SymbolStats& stats, const uint32_t* counts, size_t size, const SelectParams& params = {});
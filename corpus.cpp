@@ -0,0 +1,334 @@
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <filesystem>
+#include <fstream>
+#include <numeric>
+#if defined(__unix__) || defined(__APPLE__)
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#define HAVE_MMAP 1
+#else
+#define HAVE_MMAP 0
+#endif
+
+#include "corpus.h"
+#include "enwiki16kb.h"
+
+static constexpr size_t GENERATOR_SIZE = 1 << 16;
+static constexpr size_t DEFAULT_RUN = 4096;
+static constexpr uint64_t SEED = 0x5EED;
+
+static inline uint64_t splitmix64(uint64_t& state) {
+    uint64_t z = (state += 0x9E3779B97F4A7C15ull);
+    z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ull;
+    z = (z ^ (z >> 27)) * 0x94D049BB133111EBull;
+    return z ^ (z >> 31);
+}
+
+// the bytes of data repeated over out
+static void fill_repeated(const uint8_t* data, size_t length, uint8_t* out, size_t size) {
+    for (size_t pos = 0; pos < size; pos += length)
+        memcpy(out + pos, data, std::min(length, size - pos));
+}
+
+// the strtod of the whole string, false if it is not a number
+static bool parse_number(const std::string& text, double& value) {
+    char* end;
+    value = strtod(text.c_str(), &end);
+    return !text.empty() && *end == 0 && std::isfinite(value);
+}
+
+
+//
+// Generators
+//
+
+typedef std::array<uint8_t, 65536> QuantileTable;
+
+// the symbol of every 16-bit quantile, the probabilities of the symbols 0..255 need not be normalized
+static QuantileTable quantile_table(const std::array<double, 256>& probs) {
+    QuantileTable table;
+    double total = std::accumulate(probs.begin(), probs.end(), 0.0), cum = 0;
+    size_t begin = 0;
+    for (int s = 0; s < 256; s++) {
+        cum += probs[s];
+        size_t end = s == 255 ? table.size() : std::min(table.size(), (size_t)std::llround(cum / total * table.size()));
+        std::fill(table.begin() + begin, table.begin() + std::max(begin, end), (uint8_t)s);
+        begin = std::max(begin, end);
+    }
+    return table;
+}
+
+static std::array<double, 256> zipf_probs(double exponent) {
+    std::array<double, 256> probs;
+    for (int k = 0; k < 256; k++)
+        probs[k] = std::pow(k + 1.0, -exponent);
+    return probs;
+}
+
+static std::array<uint8_t, 256> shuffled_symbols(uint64_t& state) {
+    std::array<uint8_t, 256> symbols;
+    std::iota(symbols.begin(), symbols.end(), 0);
+    for (int i = 255; i > 0; i--)
+        std::swap(symbols[i], symbols[splitmix64(state) % (i + 1)]);
+    return symbols;
+}
+
+// independent symbols, four per splitmix64 call
+class TableSource : public CorpusSource {
+public:
+    TableSource(std::string name, const QuantileTable& table) : CorpusSource(std::move(name)), table(table) {}
+
+    size_t natural_size() const override { return GENERATOR_SIZE; }
+
+    void fill(uint8_t* out, size_t size) const override {
+        uint64_t state = SEED;
+        size_t i = 0;
+        for (; i + 4 <= size; i += 4) {
+            uint64_t r = splitmix64(state);
+            out[i] = table[r & 0xFFFF];
+            out[i + 1] = table[(r >> 16) & 0xFFFF];
+            out[i + 2] = table[(r >> 32) & 0xFFFF];
+            out[i + 3] = table[r >> 48];
+        }
+        for (uint64_t r = splitmix64(state); i < size; i++, r >>= 16)
+            out[i] = table[r & 0xFFFF];
+    }
+
+private:
+    QuantileTable table;
+};
+
+// the rank of the successor follows the table, every byte orders its successors by a permutation of its own
+class MarkovSource : public CorpusSource {
+public:
+    MarkovSource(std::string name, const QuantileTable& table) : CorpusSource(std::move(name)), table(table) {
+        uint64_t state = SEED;
+        for (auto& order : successors)
+            order = shuffled_symbols(state);
+    }
+
+    size_t natural_size() const override { return GENERATOR_SIZE; }
+
+    void fill(uint8_t* out, size_t size) const override {
+        uint64_t state = SEED;
+        uint8_t prev = 0;
+        for (size_t i = 0; i < size; i += 4) {
+            uint64_t r = splitmix64(state);
+            for (size_t j = i; j < std::min(i + 4, size); j++, r >>= 16)
+                out[j] = prev = successors[prev][table[r & 0xFFFF]];
+        }
+    }
+
+private:
+    QuantileTable table;
+    std::array<std::array<uint8_t, 256>, 256> successors;
+};
+
+class EnwikiSource : public CorpusSource {
+public:
+    EnwikiSource() : CorpusSource("enwiki") {}
+    size_t natural_size() const override { return strlen(enwiki16kb); }
+    void fill(uint8_t* out, size_t size) const override { fill_repeated((const uint8_t*)enwiki16kb, natural_size(), out, size); }
+};
+
+// runs of run bytes from every part in turn, each part continues where its previous run ended
+class MixSource : public CorpusSource {
+public:
+    MixSource(std::string name, std::vector<std::unique_ptr<CorpusSource>> parts, size_t run)
+        : CorpusSource(std::move(name)), parts(std::move(parts)), run(run) {}
+
+    size_t natural_size() const override { return GENERATOR_SIZE; }
+
+    void fill(uint8_t* out, size_t size) const override {
+        size_t runs = (size + run - 1) / run;
+        std::vector<uint8_t> part;
+        for (size_t k = 0; k < parts.size() && k < runs; k++) {
+            size_t part_runs = (runs - k + parts.size() - 1) / parts.size();
+            part.resize(part_runs * run);
+            parts[k]->fill(part.data(), part.size());
+            for (size_t j = 0; j < part_runs; j++) {
+                size_t pos = (j * parts.size() + k) * run;
+                memcpy(out + pos, part.data() + j * run, std::min(run, size - pos));
+            }
+        }
+    }
+
+private:
+    std::vector<std::unique_ptr<CorpusSource>> parts;
+    size_t run;
+};
+
+
+//
+// Files
+//
+
+class FileSource : public CorpusSource {
+public:
+    explicit FileSource(const std::string& path) : CorpusSource(path) {}
+
+    ~FileSource() override {
+#if HAVE_MMAP
+        if (data)
+            munmap((void*)data, size);
+#endif
+    }
+
+    // false for the files that cannot be read and the empty ones
+    bool open(std::string* error) {
+#if HAVE_MMAP
+        int fd = ::open(name().c_str(), O_RDONLY);
+        struct stat st;
+        if (fd >= 0 && fstat(fd, &st) == 0 && st.st_size > 0) {
+            void* ptr = mmap(nullptr, (size_t)st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+            if (ptr != MAP_FAILED) {
+                data = (const uint8_t*)ptr;
+                size = (size_t)st.st_size;
+            }
+        }
+        if (fd >= 0)
+            close(fd);
+#else
+        std::ifstream file(name(), std::ios::binary);
+        contents.assign(std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>());
+        data = contents.data();
+        size = contents.size();
+#endif
+        if (size == 0 && error)
+            *error = "cannot read " + name() + " or it is empty";
+        return size != 0;
+    }
+
+    size_t natural_size() const override { return size; }
+    void fill(uint8_t* out, size_t n) const override { fill_repeated(data, size, out, n); }
+
+private:
+    const uint8_t* data = nullptr;
+    size_t size = 0;
+#if !HAVE_MMAP
+    std::vector<uint8_t> contents;
+#endif
+};
+
+
+//
+// Specs
+//
+
+std::vector<std::unique_ptr<CorpusSource>> open_sources(const std::string& spec, std::string* error) {
+    std::vector<std::unique_ptr<CorpusSource>> sources;
+    auto fail = [&](const std::string& why) {
+        if (error)
+            *error = why;
+        sources.clear();
+        return std::move(sources);
+    };
+
+    size_t colon = spec.find(':');
+    std::string kind = spec.substr(0, colon), arg = colon == std::string::npos ? "" : spec.substr(colon + 1);
+    double param;
+    if (kind == "geo" || kind == "zipf" || kind == "markov") {
+        if (!parse_number(arg, param) || (kind == "geo" ? param <= 0 || param > 1 : param < 0))
+            return fail("bad parameter of " + spec);
+        std::array<double, 256> probs = zipf_probs(param);
+        if (kind == "geo") {
+            for (int k = 0; k < 256; k++)
+                probs[k] = k < 255 ? param * std::pow(1 - param, k) : std::pow(1 - param, 255);
+            sources.push_back(std::make_unique<TableSource>(spec, quantile_table(probs)));
+        } else if (kind == "zipf") {
+            uint64_t state = SEED;
+            std::array<uint8_t, 256> order = shuffled_symbols(state);
+            std::array<double, 256> shuffled;
+            for (int k = 0; k < 256; k++)
+                shuffled[order[k]] = probs[k];
+            sources.push_back(std::make_unique<TableSource>(spec, quantile_table(shuffled)));
+        } else {
+            sources.push_back(std::make_unique<MarkovSource>(spec, quantile_table(probs)));
+        }
+    } else if (spec == "uniform") {
+        std::array<double, 256> probs;
+        probs.fill(1);
+        sources.push_back(std::make_unique<TableSource>(spec, quantile_table(probs)));
+    } else if (spec == "enwiki") {
+        sources.push_back(std::make_unique<EnwikiSource>());
+    } else if (kind == "mix") {
+        size_t at = arg.rfind('@');
+        double run = DEFAULT_RUN;
+        if (at != std::string::npos && (!parse_number(arg.substr(at + 1), run) || run < 1))
+            return fail("bad run length of " + spec);
+        std::vector<std::unique_ptr<CorpusSource>> parts;
+        std::string list = arg.substr(0, at);
+        for (size_t begin = 0, end; begin <= list.size(); begin = end + 1) {
+            end = std::min(list.find('+', begin), list.size());
+            auto part = open_sources(list.substr(begin, end - begin), error);
+            if (part.size() != 1)
+                return fail(part.empty() ? (error ? *error : "") : "a directory in " + spec);
+            parts.push_back(std::move(part[0]));
+        }
+        sources.push_back(std::make_unique<MixSource>(spec, std::move(parts), (size_t)run));
+    } else {
+        std::error_code ec;
+        std::vector<std::string> paths;
+        if (std::filesystem::is_directory(spec, ec)) {
+            for (const auto& entry : std::filesystem::recursive_directory_iterator(spec, ec)) {
+                if (entry.is_regular_file(ec) && entry.file_size(ec) > 0)
+                    paths.push_back(entry.path().string());
+            }
+            std::sort(paths.begin(), paths.end());
+            if (paths.empty())
+                return fail("no files in " + spec);
+        } else {
+            paths.push_back(spec);
+        }
+        for (const std::string& path : paths) {
+            auto file = std::make_unique<FileSource>(path);
+            if (!file->open(error))
+                return fail(error ? *error : "");
+            sources.push_back(std::move(file));
+        }
+    }
+    return sources;
+}
+
+bool parse_sizes(const std::string& list, std::vector<size_t>& sizes) {
+    auto parse_size = [](std::string text, size_t& size) {
+        int shift = 0;
+        if (!text.empty() && strchr("KMG", text.back())) {
+            shift = text.back() == 'K' ? 10 : text.back() == 'M' ? 20 : 30;
+            text.pop_back();
+        }
+        char* end;
+        unsigned long long value = strtoull(text.c_str(), &end, 10);
+        size = (size_t)value << shift;
+        return !text.empty() && *end == 0 && text[0] != '-' && size >> shift == value;
+    };
+
+    sizes.clear();
+    for (size_t begin = 0, end; begin <= list.size(); begin = end + 1) {
+        end = std::min(list.find(',', begin), list.size());
+        std::string item = list.substr(begin, end - begin);
+        size_t dots = item.find("..");
+        size_t min_size, max_size;
+        if (dots == std::string::npos) {
+            if (!parse_size(item, min_size))
+                return false;
+            sizes.push_back(min_size);
+        } else {
+            if (!parse_size(item.substr(0, dots), min_size) || !parse_size(item.substr(dots + 2), max_size) || min_size == 0)
+                return false;
+            for (size_t size = min_size; size <= max_size; size *= 4) {
+                sizes.push_back(size);
+                if (size > max_size / 4)
+                    break;
+            }
+        }
+    }
+    return !sizes.empty();
+}
@@ -0,0 +1,50 @@
+//
+// Inputs of the tests and benchmarks: files mapped read-only (read into memory where mmap is missing), the files
+// of a directory and seeded synthetic sources. Every source fills a sample of any size, so one source can be
+// measured from a few hundred bytes to several GB; files shorter than the sample are repeated from their start.
+//
+// source specs:
+//   geo:P              geometric symbols with the parameter P (cut at 255)
+//   zipf:S             Zipf's law with the exponent S over 256 symbols in a shuffled order
+//   markov:S           order 1: the successors of every byte follow zipf:S in an order of their own
+//   uniform            random bytes
+//   enwiki             the enwiki8 prefix compiled into the library (enwiki16kb.h)
+//   mix:A+B+...@RUN    runs of RUN bytes (4096 by default) taken in turn from the sources A, B, ...
+//   path               a file, or every regular file under a directory as a source of its own
+//
+// The generators draw 16-bit quantiles from splitmix64 and map them through a 64K-entry table, so the symbols
+// with probabilities below 2^-16 do not occur, and a few GB take seconds.
+//
+
+#pragma once
+
+#include <memory>
+#include <string>
+#include <vector>
+#include <stddef.h>
+#include <stdint.h>
+
+class CorpusSource {
+public:
+    virtual ~CorpusSource() = default;
+
+    // the spec of the source, the path for the files of a directory
+    const std::string& name() const { return source_name; }
+    // the size of a file, 64 KB for the generators
+    virtual size_t natural_size() const = 0;
+    // the first size bytes of the source, the same for the same spec
+    virtual void fill(uint8_t* out, size_t size) const = 0;
+
+protected:
+    explicit CorpusSource(std::string name) : source_name(std::move(name)) {}
+
+private:
+    std::string source_name;
+};
+
+// the sources of a spec, none if it is malformed or a file cannot be read (error says why)
+std::vector<std::unique_ptr<CorpusSource>> open_sources(const std::string& spec, std::string* error = nullptr);
+
+// sizes like 256, 64K, 16M or 4G separated by commas, min..max steps by 4x from min up to max;
+// false if the list is malformed
+bool parse_sizes(const std::string& list, std::vector<size_t>& sizes);
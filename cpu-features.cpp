@@ -0,0 +1,92 @@
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "cpu-features.h"
+
+#if RANS_X86 && defined(_MSC_VER)
+#include <intrin.h>
+#elif RANS_X86
+#include <cpuid.h>
+#endif
+
+#if RANS_X86
+static void cpuid(uint32_t leaf, uint32_t subleaf, uint32_t regs[4]) {
+#if defined(_MSC_VER)
+    int r[4];
+    __cpuidex(r, (int)leaf, (int)subleaf);
+    for (int i = 0; i < 4; i++)
+        regs[i] = (uint32_t)r[i];
+#else
+    __cpuid_count(leaf, subleaf, regs[0], regs[1], regs[2], regs[3]);
+#endif
+}
+
+// the state components enabled by the OS, only valid when CPUID reports OSXSAVE
+static uint64_t xgetbv0() {
+#if defined(_MSC_VER)
+    return _xgetbv(0);
+#else
+    uint32_t lo, hi;
+    __asm__ volatile("xgetbv" : "=a"(lo), "=d"(hi) : "c"(0));
+    return ((uint64_t)hi << 32) | lo;
+#endif
+}
+
+static CpuLevel detect_cpu_level() {
+    uint32_t regs[4];
+    cpuid(0, 0, regs);
+    uint32_t max_leaf = regs[0];
+    if (max_leaf < 7)
+        return CPU_BASELINE;
+    cpuid(0x80000000, 0, regs);
+    if (regs[0] < 0x80000001)
+        return CPU_BASELINE;
+
+    cpuid(1, 0, regs);
+    bool osxsave = (regs[2] >> 27) & 1;
+    bool avx = (regs[2] >> 28) & 1;
+    cpuid(7, 0, regs);
+    bool bmi1 = (regs[1] >> 3) & 1;
+    bool avx2 = (regs[1] >> 5) & 1;
+    bool bmi2 = (regs[1] >> 8) & 1;
+    cpuid(0x80000001, 0, regs);
+    bool lzcnt = (regs[2] >> 5) & 1;
+
+    if (!bmi1 || !bmi2 || !lzcnt)
+        return CPU_BASELINE;
+    // the xmm and ymm registers are saved by the OS
+    if (avx2 && avx && osxsave && (xgetbv0() & 6) == 6)
+        return CPU_AVX2;
+    return CPU_BMI2;
+}
+#else
+static CpuLevel detect_cpu_level() {
+    return CPU_BASELINE;
+}
+#endif
+
+static CpuLevel select_cpu_level() {
+    CpuLevel level = detect_cpu_level();
+    const char* forced = getenv("RANS_CPU");
+    if (!forced)
+        return level;
+    for (int l = CPU_BASELINE; l <= CPU_AVX2; l++) {
+        if (strcmp(forced, cpu_level_name((CpuLevel)l)) == 0)
+            return l < level ? (CpuLevel)l : level;
+    }
+    return level;
+}
+
+CpuLevel cpu_level() {
+    static const CpuLevel level = select_cpu_level();
+    return level;
+}
+
+const char* cpu_level_name(CpuLevel level) {
+    switch (level) {
+    case CPU_BMI2: return "bmi2";
+    case CPU_AVX2: return "avx2";
+    default: return "baseline";
+    }
+}
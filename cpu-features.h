@@ -0,0 +1,47 @@
+#pragma once
+
+//
+// Runtime selection of the coding kernels: the library is built for the x86-64 baseline and the kernels
+// compiled for BMI2 or AVX2 are picked once through CPUID, so one binary runs on every x86-64 CPU.
+//
+
+#if defined(__x86_64__) || defined(_M_X64) || defined(__i386__) || defined(_M_IX86)
+#define RANS_X86 1
+#else
+#define RANS_X86 0
+#endif
+
+// per-function instruction sets; MSVC emits the intrinsics of any instruction set without them
+#if RANS_X86 && (defined(__GNUC__) || defined(__clang__))
+#define TARGET_BMI2 __attribute__((target("bmi,bmi2,lzcnt")))
+#define TARGET_AVX2 __attribute__((target("avx2,bmi,bmi2,lzcnt")))
+#else
+#define TARGET_BMI2
+#define TARGET_AVX2
+#endif
+
+// a kernel body is inlined into the entry of every instruction set and compiled for it there
+#if defined(_MSC_VER)
+#define FORCE_INLINE __forceinline
+#else
+#define FORCE_INLINE inline __attribute__((always_inline))
+#endif
+
+// the rare paths kept out of the loops of the kernels
+#if defined(_MSC_VER)
+#define NOINLINE __declspec(noinline)
+#else
+#define NOINLINE __attribute__((noinline, cold))
+#endif
+
+// every level includes the previous ones: BMI2 also requires BMI1 and LZCNT, AVX2 the OS support of the ymm state
+enum CpuLevel {
+    CPU_BASELINE,
+    CPU_BMI2,
+    CPU_AVX2,
+};
+
+// the level of the CPU detected on the first call; the environment variable RANS_CPU=baseline|bmi2|avx2
+// lowers it, e.g. to compare the kernels on one machine
+CpuLevel cpu_level();
+const char* cpu_level_name(CpuLevel level);
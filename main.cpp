@@ -1,126 +1,742 @@
 #include <iostream>
+#include <algorithm>
 #include <vector>
 #include <random>
 #include <chrono>
 #include <bit>
+#include <utility>
+#include <thread>
+#include <memory>
+#include <span>
+#include <string>
 #include <stdint.h>
-#include <intrin.h>
-#include <immintrin.h>
 
 #include "rans.h"
-#include "rans-fast.h"
 #include "rans-fixed-accuracy.h"
-#include "rans-fixed-accuracy-2.h"
-#include "enwiki16kb.h"
+#include "rans-order1.h"
+#include "rans-wide.h"
+#include "sym-stats.h"
+#include "table-cache.h"
+#include "stream-header.h"
+#include "block-container.h"
+#include "thread-pool.h"
+#include "stream-coder.h"
+#include "corpus.h"
 
 
-static void test_sequence(const std::vector<uint8_t> & sequence) {
+template <int STATE_BITS, int ACCURACY_BITS>
+static void test_fixed_accuracy(const std::vector<uint8_t>& sequence) {
 	using namespace std::chrono;
+	typedef FixedAccuracyRans<STATE_BITS, ACCURACY_BITS> Rans;
 
 	constexpr int iters = 5;
 
-	std::vector<uint8_t> encoded_sequence(sequence.size() * 2 + 10);
+	std::vector<uint8_t> encoded_sequence(Rans::max_encoded_size(sequence.size(), 4));
 	std::vector<uint8_t> decode_buffer(sequence.size() + 10);
-	
-	long long ms_rans = 0, ms_rans2 = 0, res_rans = 0;
-	for (int i = 0; i < iters; i++) {
-		auto t1_rans = high_resolution_clock::now();
-		auto rANSinfo = init_rANS(sequence);
-		res_rans = encode_rANS(sequence, encoded_sequence, rANSinfo.esyms);
-		auto t2_rans = high_resolution_clock::now();
-		ms_rans += duration_cast<nanoseconds>(t2_rans - t1_rans).count();
-		auto t1_rans_2 = high_resolution_clock::now();
-		decode_rANS(rANSinfo.dsyms, rANSinfo.cum2sym, &(*(encoded_sequence.end() - res_rans)), decode_buffer.data(), sequence.size());
-		auto t2_rans_2 = high_resolution_clock::now();
-		ms_rans2 += duration_cast<nanoseconds>(t2_rans_2 - t1_rans_2).count();
-	}
-	ms_rans /= iters;
-	ms_rans2 /= iters;
-
-
-	long long ms_ransf = 0, ms_ransf2 = 0, res_ransf = 0;
-	for (int i = 0; i < iters; i++) {
-		auto t1_ransf = high_resolution_clock::now();
-		auto rANSfast_info = init_rANS_fast(sequence);
-		res_ransf = encode_rANS_fast(sequence, encoded_sequence, rANSfast_info.esyms);
-		auto t2_ransf = high_resolution_clock::now();
-		ms_ransf += duration_cast<nanoseconds>(t2_ransf - t1_ransf).count();
-		auto t1_ransf_2 = high_resolution_clock::now();
-		decode_rANS_fast(rANSfast_info.dsyms, rANSfast_info.cum2sym, &(*(encoded_sequence.end() - res_ransf)), decode_buffer.data(), sequence.size());
-		auto t2_ransf_2 = high_resolution_clock::now();
-		ms_ransf2 += duration_cast<nanoseconds>(t2_ransf_2 - t1_ransf_2).count();
-	}
-	ms_ransf /= iters;
-	ms_ransf2 /= iters;
-
 
 	long long ms_ours = 0, ms_ours2 = 0, res_ours = 0;
-	std::fill(decode_buffer.begin(), decode_buffer.end(), 0);
+	bool ok = true;
 	for (int i = 0; i < iters; i++) {
 		auto t1_ours = high_resolution_clock::now();
-		auto info = init_rANS_with_accuracy_3(sequence);
-		res_ours = encode_rANS_with_accuracy_3(sequence, encoded_sequence, info.esyms);
+		auto info = Rans::init(sequence);
+		res_ours = Rans::template encode_interleaved<4>(sequence, encoded_sequence, info.esyms);
 		auto t2_ours = high_resolution_clock::now();
 		ms_ours += duration_cast<nanoseconds>(t2_ours - t1_ours).count();
 		auto t1_ours_2 = high_resolution_clock::now();
-		decode_rANS(info.dsyms.data(), info.cum2sym.data(), encoded_sequence.data() + res_ours, decode_buffer.data(), decode_buffer.data() + sequence.size());
+		ok &= Rans::template decode_interleaved<4>(info.dsyms.data(), info.cum2sym.data(), encoded_sequence.data(), encoded_sequence.data() + res_ours, decode_buffer.data(), decode_buffer.data() + sequence.size());
 		auto t2_ours_2 = high_resolution_clock::now();
 		ms_ours2 += duration_cast<nanoseconds>(t2_ours_2 - t1_ours_2).count();
 	}
 	ms_ours /= iters;
 	ms_ours2 /= iters;
-	if (!std::equal(sequence.begin(), sequence.end(), decode_buffer.begin()))
-		std::cout << "ERROR! sequence decompressed incorrectly by rANS with accuracy 3" << std::endl;
-
+	if (!ok || !std::equal(sequence.begin(), sequence.end(), decode_buffer.begin()))
+		std::cout << "ERROR! sequence decompressed incorrectly by rANS with state bits " << STATE_BITS << " and accuracy " << ACCURACY_BITS << std::endl;
 
-	long long ms_oursX = 0, ms_ours2X = 0, res_oursX = 0;
+	long long ms_table = 0;
 	std::fill(decode_buffer.begin(), decode_buffer.end(), 0);
+	auto info = Rans::init(sequence);
+	auto states = Rans::init_dec_states(info.dsyms, info.cum2sym);
 	for (int i = 0; i < iters; i++) {
-		auto t1_oursX = high_resolution_clock::now();
-		auto infoX = init_rANS_with_accuracy_2(sequence);
-		res_oursX = encode_rANS_with_accuracy_2(sequence, encoded_sequence, infoX.esyms);
-		auto t2_oursX = high_resolution_clock::now();
-		ms_oursX += duration_cast<nanoseconds>(t2_oursX - t1_oursX).count();
-		auto t1_ours_2X = high_resolution_clock::now();
-		decode_rANS_2(infoX.dsyms.data(), infoX.cum2sym.data(), encoded_sequence.data() + res_oursX, decode_buffer.data(), decode_buffer.data() + sequence.size());
-		auto t2_ours_2X = high_resolution_clock::now();
-		ms_ours2X += duration_cast<nanoseconds>(t2_ours_2X - t1_ours_2X).count();
-	}
-	ms_oursX /= iters;
-	ms_ours2X /= iters;
-	if (!std::equal(sequence.begin(), sequence.end(), decode_buffer.begin()))
-		std::cout << "ERROR! sequence decompressed incorrectly by rANS with accuracy 2" << std::endl;
-
-
-	std::cout << "Comp/decomp time rANS with acc 3: " << ms_ours  << "/" << ms_ours2  << " ns, compressed len: " << res_ours << std::endl;
-	std::cout << "Comp/decomp time rANS with acc 2: " << ms_oursX << "/" << ms_ours2X << " ns, compressed len: " << res_oursX << std::endl;
-	std::cout << "Comp/decomp time rANS:            " << ms_rans  << "/" << ms_rans2  << " ns, compressed len: " << res_rans << std::endl;
-	std::cout << "Comp/decomp time rANS fast:       " << ms_ransf << "/" << ms_ransf2 << " ns, compressed len: " << res_ransf << std::endl << std::endl;
-}
-
-int main() {
-	std::vector<uint8_t> sequence(1 << 16);
+		auto t1_table = high_resolution_clock::now();
+		ok &= Rans::template decode_table_interleaved<4>(states.data(), encoded_sequence.data(), encoded_sequence.data() + res_ours, decode_buffer.data(), decode_buffer.data() + sequence.size());
+		auto t2_table = high_resolution_clock::now();
+		ms_table += duration_cast<nanoseconds>(t2_table - t1_table).count();
+	}
+	ms_table /= iters;
+	if (!ok || !std::equal(sequence.begin(), sequence.end(), decode_buffer.begin()))
+		std::cout << "ERROR! sequence decompressed incorrectly by table rANS with state bits " << STATE_BITS << " and accuracy " << ACCURACY_BITS << std::endl;
+
+	std::cout << "Comp/decomp/table decomp time 4-way rANS with state bits " << STATE_BITS << ", acc " << ACCURACY_BITS << ": "
+		<< ms_ours << "/" << ms_ours2 << "/" << ms_table << " ns, compressed len: " << res_ours
+		<< ", state table: " << states.size() * sizeof(states[0]) / 1024 << " KB" << std::endl;
+}
+
+template <int STATE_BITS, int... ACCURACY_BITS>
+static void sweep_fixed_accuracy(const std::vector<uint8_t>& sequence, std::integer_sequence<int, ACCURACY_BITS...>) {
+	(test_fixed_accuracy<STATE_BITS, ACCURACY_BITS + 1>(sequence), ...);
+}
+
+template <int... STATE_BITS>
+static void sweep_fixed_accuracy(const std::vector<uint8_t>& sequence, std::integer_sequence<int, STATE_BITS...>) {
+	(sweep_fixed_accuracy<STATE_BITS + 10>(sequence, std::make_integer_sequence<int, 6>()), ...);
+}
+
+// code length with the statistics of a sample against the one with the exact statistics
+static void test_sampled_stats(const std::vector<uint8_t>& sequence, const SampleParams& params) {
+	using namespace std::chrono;
+
+	constexpr uint32_t prob_scale = 1 << 14;
+
+	SymbolStats exact;
+	auto t1_exact = high_resolution_clock::now();
+	exact.count_freqs(sequence.data(), sequence.size());
+	auto t2_exact = high_resolution_clock::now();
+	uint32_t counts[256];
+	std::copy(exact.freqs, exact.freqs + 256, counts);
+	exact.normalize_freqs(prob_scale);
+
+	SymbolStats sampled;
+	auto t1_sampled = high_resolution_clock::now();
+	sampled.count_freqs_sampled(sequence.data(), sequence.size(), params);
+	auto t2_sampled = high_resolution_clock::now();
+	sampled.normalize_freqs(prob_scale);
+
+	std::vector<uint8_t> encoded_sequence(RansWithAccuracy3::max_encoded_size(sequence.size()));
+	std::vector<uint8_t> decode_buffer(sequence.size() + 10);
+	auto info = init_rANS_with_accuracy_3(sequence, &params);
+	int res = encode_rANS_with_accuracy_3(sequence, encoded_sequence, info.esyms);
+	bool ok = decode_rANS(info.dsyms.data(), info.cum2sym.data(), encoded_sequence.data(), encoded_sequence.data() + res, decode_buffer.data(), decode_buffer.data() + sequence.size());
+	if (!ok || !std::equal(sequence.begin(), sequence.end(), decode_buffer.begin()))
+		std::cout << "ERROR! sequence decompressed incorrectly by rANS with accuracy 3 and sampled statistics" << std::endl;
+
+	std::cout << "Sampled stats, 1/" << params.rate << " of " << params.block_size << "-byte blocks" << (params.random ? " (random)" : "")
+		<< ": count time " << duration_cast<nanoseconds>(t2_sampled - t1_sampled).count() << "/" << duration_cast<nanoseconds>(t2_exact - t1_exact).count()
+		<< " ns, cost ratio: " << sampled.code_length(counts) / exact.code_length(counts) << ", compressed len: " << res << std::endl;
+}
+
+// messages drawn from a few repeating distributions, the tables are built once per distribution
+static void test_table_cache(const std::vector<uint8_t>& sequence) {
+	using namespace std::chrono;
+
+	constexpr int messages = 256, distributions = 4, threads = 4;
+	constexpr size_t message_size = 1024;
+
+	std::vector<SymbolStats> stats(distributions);
+	for (int d = 0; d < distributions; d++) {
+		stats[d].count_freqs(sequence.data() + d * message_size, message_size);
+		stats[d].normalize_freqs(1 << 14);
+	}
+
+	auto t1_build = high_resolution_clock::now();
+	for (int m = 0; m < messages; m++) {
+		auto info = init_rANS_with_accuracy_3(stats[m % distributions]);
+		if (info.cum2sym.empty())
+			std::cout << "ERROR! empty tables" << std::endl;
+	}
+	auto t2_build = high_resolution_clock::now();
+
+	auto use_cache = [&](TableCache<SequenceInfo>& cache) {
+		std::vector<std::thread> workers;
+		for (int t = 0; t < threads; t++) {
+			workers.emplace_back([&, t] {
+				for (int m = t; m < messages; m += threads) {
+					auto info = cache.get(stats[m % distributions]);
+					if (info->dsyms[info->cum2sym[0]].freq != stats[m % distributions].freqs[info->cum2sym[0]])
+						std::cout << "ERROR! table cache returned wrong tables" << std::endl;
+				}
+			});
+		}
+		for (auto& worker : workers)
+			worker.join();
+	};
+	TableCache<SequenceInfo> cache(RansWithAccuracy3::init, 16);
+	auto t1_cache = high_resolution_clock::now();
+	use_cache(cache);
+	auto t2_cache = high_resolution_clock::now();
+	// more distributions than entries: the entries are evicted and freed while the other threads look them up
+	TableCache<SequenceInfo> small_cache(RansWithAccuracy3::init, 2);
+	use_cache(small_cache);
+
+	std::cout << "Tables for " << messages << " messages, built/cached on " << threads << " threads: "
+		<< duration_cast<nanoseconds>(t2_build - t1_build).count() << "/" << duration_cast<nanoseconds>(t2_cache - t1_cache).count()
+		<< " ns, cache hits/misses: " << cache.hits() << "/" << cache.misses() << std::endl << std::endl;
+}
+
+// small messages coded one by one: the tables are rebuilt for every message either in new vectors or in a reused context
+static void test_contexts(const std::vector<uint8_t>& sequence) {
+	using namespace std::chrono;
+
+	constexpr size_t message_size = 1024;
+	const size_t messages = sequence.size() / message_size;
+
+	std::vector<uint8_t> encoded(RansWithAccuracy3::max_encoded_size(message_size));
+	std::vector<uint8_t> decoded(message_size);
+
+	auto t1_alloc = high_resolution_clock::now();
+	for (size_t m = 0; m < messages; m++) {
+		std::span<const uint8_t> message(sequence.data() + m * message_size, message_size);
+		auto info = init_rANS_with_accuracy_3(message);
+		int res = encode_rANS_with_accuracy_3(message, encoded, info.esyms);
+		bool ok = decode_rANS(info.dsyms.data(), info.cum2sym.data(), encoded.data(), encoded.data() + res, decoded.data(), decoded.data() + message_size);
+		if (!ok || !std::equal(message.begin(), message.end(), decoded.begin()))
+			std::cout << "ERROR! message decompressed incorrectly by rANS with accuracy 3" << std::endl;
+	}
+	auto t2_alloc = high_resolution_clock::now();
+
+	auto ctx = std::make_unique<RansContext>();
+	auto t1_ctx = high_resolution_clock::now();
+	for (size_t m = 0; m < messages; m++) {
+		std::span<const uint8_t> message(sequence.data() + m * message_size, message_size);
+		ctx->init(message);
+		int res = encode_rANS_with_accuracy_3(message, encoded, ctx->esyms);
+		bool ok = decode_rANS(ctx->dsyms, ctx->cum2sym, encoded.data(), encoded.data() + res, decoded.data(), decoded.data() + message_size);
+		if (!ok || !std::equal(message.begin(), message.end(), decoded.begin()))
+			std::cout << "ERROR! message decompressed incorrectly by rANS with accuracy 3 and a context" << std::endl;
+	}
+	auto t2_ctx = high_resolution_clock::now();
+
+	std::cout << messages << " messages of " << message_size << " bytes with new tables/a reused context: "
+		<< duration_cast<nanoseconds>(t2_alloc - t1_alloc).count() / messages << "/" << duration_cast<nanoseconds>(t2_ctx - t1_ctx).count() / messages
+		<< " ns per message" << std::endl << std::endl;
+}
+
+// one pass over the input with the adaptive model against the static tables counted on the whole input
+static void test_adaptive(const std::vector<uint8_t>& sequence, const AdaptiveParams& params) {
+	using namespace std::chrono;
+
+	std::vector<uint8_t> encoded(RansWithAccuracy3::max_encoded_size(sequence.size()));
+	std::vector<uint8_t> decoded(sequence.size());
+	std::span<uint8_t> payload(encoded);
+
+	auto info = init_rANS_with_accuracy_3(sequence);
+	int static_size = encode_rANS_with_accuracy_3(sequence, payload, info.esyms);
+
+	auto t1 = high_resolution_clock::now();
+	int res = encode_rANS_with_accuracy_3_adaptive(sequence, payload, params);
+	auto t2 = high_resolution_clock::now();
+	bool ok = decode_rANS_adaptive(payload.data(), payload.data() + res, decoded.data(), decoded.data() + decoded.size(), params);
+	auto t3 = high_resolution_clock::now();
+	if (!ok || !std::equal(sequence.begin(), sequence.end(), decoded.begin()))
+		std::cout << "ERROR! adaptive rANS with accuracy 3 decompressed incorrectly" << std::endl;
+
+	std::cout << "Adaptive rANS with accuracy 3, period " << params.period << ", decay 1/" << (1ull << std::clamp(params.decay_shift, 0, 16)) << ": "
+		<< res << " bytes (static " << static_size << "), comp/decomp time: " << duration_cast<nanoseconds>(t2 - t1).count()
+		<< "/" << duration_cast<nanoseconds>(t3 - t2).count() << " ns" << std::endl;
+}
+
+// the previous byte as the context against the order-0 tables, both with their serialized models
+template <typename Order1>
+static void test_order1(const std::vector<uint8_t>& sequence) {
+	using namespace std::chrono;
+
+	std::vector<uint8_t> encoded(Order1::max_encoded_size(sequence.size()));
+	std::vector<uint8_t> decoded(sequence.size());
+	std::span<uint8_t> payload(encoded);
+
+	SymbolStats stats;
+	stats.count_freqs(sequence.data(), sequence.size());
+	stats.normalize_freqs(Order1::Rans::STATE_MASK + 1);
+	auto info = Order1::Rans::init(stats);
+	int order0_size = Order1::Rans::encode(sequence, payload, info.esyms);
+	uint8_t freq_table[MAX_FREQ_TABLE_SIZE];
+	size_t order0_model = write_freq_table(stats.freqs, freq_table) - freq_table;
+
+	typename Order1::Model model;
+	Order1::init(sequence, model);
+	std::vector<uint8_t> model_buf(Order1::max_model_size(model));
+	size_t model_size = Order1::write_model(model, model_buf.data());
+
+	// the decoder only sees the serialized model
+	typename Order1::Model read;
+	if (Order1::read_model(model_buf.data(), model_size, read) != model_size)
+		std::cout << "ERROR! order-1 model read incorrectly" << std::endl;
+
+	auto t1 = high_resolution_clock::now();
+	int res = Order1::encode(sequence, payload, model);
+	auto t2 = high_resolution_clock::now();
+	bool ok = Order1::decode(read, payload.data(), payload.data() + res, decoded.data(), decoded.data() + decoded.size());
+	auto t3 = high_resolution_clock::now();
+	if (!ok || !std::equal(sequence.begin(), sequence.end(), decoded.begin()))
+		std::cout << "ERROR! order-1 rANS decompressed incorrectly" << std::endl;
+
+	std::cout << "Order-1 rANS, " << model.contexts << " contexts in " << model.table_bytes() / 1024 << " KB: "
+		<< res << " + " << model_size << " bytes (order-0 " << order0_size << " + " << order0_model
+		<< "), comp/decomp time: " << duration_cast<nanoseconds>(t2 - t1).count() << "/" << duration_cast<nanoseconds>(t3 - t2).count()
+		<< " ns" << std::endl;
+}
+
+// values of a wider alphabet coded directly against their little-endian bytes coded by the order-0 byte coder
+template <typename Wide>
+static void test_wide(const std::vector<typename Wide::symbol_t>& values) {
+	using namespace std::chrono;
+
+	std::vector<uint8_t> encoded(Wide::max_encoded_size(values.size() * 2));
+	std::span<uint8_t> payload(encoded);
+
+	std::vector<uint8_t> bytes(values.size() * 2);
+	for (size_t i = 0; i < values.size(); i++) {
+		bytes[2 * i] = (uint8_t)values[i];
+		bytes[2 * i + 1] = (uint8_t)(values[i] >> 8);
+	}
+	auto info = init_rANS_with_accuracy_3(bytes);
+	int bytes_size = encode_rANS_with_accuracy_3(bytes, payload, info.esyms);
+
+	typename Wide::Tables tables;
+	if (!Wide::init(values, tables)) {
+		std::cout << "ERROR! too many distinct symbols for the wide rANS" << std::endl;
+		return;
+	}
+	std::vector<uint8_t> model(Wide::max_model_size(tables));
+	size_t model_size = Wide::write_model(tables, model.data());
+	typename Wide::Tables read;
+	if (Wide::read_model(model.data(), model_size, read) != model_size)
+		std::cout << "ERROR! wide rANS model read incorrectly" << std::endl;
+
+	std::vector<typename Wide::symbol_t> decoded(values.size());
+	auto t1 = high_resolution_clock::now();
+	int res = Wide::encode(values, payload, tables);
+	auto t2 = high_resolution_clock::now();
+	bool ok = Wide::decode(read, payload.data(), payload.data() + res, decoded.data(), decoded.data() + decoded.size());
+	auto t3 = high_resolution_clock::now();
+	if (!ok || values != decoded)
+		std::cout << "ERROR! wide rANS decompressed incorrectly" << std::endl;
+
+	std::cout << "rANS on " << Wide::ALPHABET_SIZE << " symbols, " << tables.symbols() << " present in " << tables.table_bytes() / 1024 << " KB: "
+		<< res << " + " << model_size << " bytes (as bytes " << bytes_size << "), comp/decomp time: "
+		<< duration_cast<nanoseconds>(t2 - t1).count() << "/" << duration_cast<nanoseconds>(t3 - t2).count() << " ns" << std::endl;
+}
+
+// the stream is decoded with the tables rebuilt from its header only
+static void test_stream_header(const std::vector<uint8_t>& sequence) {
+	using namespace std::chrono;
+
+	constexpr int iters = 1000;
+
+	StreamHeader header = { .variant = STREAM_FIXED_ACCURACY, .prob_bits = 14, .accuracy_bits = 3, .ways = 1, .original_size = sequence.size(), .encoded_size = 0, .stats = {} };
+	header.stats.count_freqs(sequence.data(), sequence.size());
+	header.stats.normalize_freqs(1 << 14);
+	auto info = init_rANS_with_accuracy_3(header.stats);
+
+	std::vector<uint8_t> payload(RansWithAccuracy3::max_encoded_size(sequence.size()));
+	header.encoded_size = encode_rANS_with_accuracy_3(sequence, payload, info.esyms);
+	std::vector<uint8_t> stream(MAX_STREAM_HEADER_SIZE + header.encoded_size);
+	size_t header_size = write_stream_header(header, stream.data());
+	std::copy(payload.begin(), payload.begin() + header.encoded_size, stream.begin() + header_size);
+
+	StreamHeader parsed;
+	long long ns_parse = 0, ns_tables = 0;
+	size_t parsed_size = 0;
+	for (int i = 0; i < iters; i++) {
+		auto t1 = high_resolution_clock::now();
+		parsed_size = read_stream_header(stream.data(), stream.size(), parsed);
+		auto t2 = high_resolution_clock::now();
+		info = init_rANS_with_accuracy_3(parsed.stats);
+		auto t3 = high_resolution_clock::now();
+		ns_parse += duration_cast<nanoseconds>(t2 - t1).count();
+		ns_tables += duration_cast<nanoseconds>(t3 - t2).count();
+	}
+
+	std::vector<uint8_t> decode_buffer(parsed.original_size + 10);
+	bool ok = decode_rANS(info.dsyms.data(), info.cum2sym.data(), stream.data() + parsed_size, stream.data() + parsed_size + parsed.encoded_size,
+		decode_buffer.data(), decode_buffer.data() + parsed.original_size);
+	if (!ok || parsed_size != header_size || !std::equal(sequence.begin(), sequence.end(), decode_buffer.begin()))
+		std::cout << "ERROR! stream decompressed incorrectly from its header" << std::endl;
+
+	std::cout << "Stream header: " << header_size << " bytes, parse/table build time: " << ns_parse / iters << "/" << ns_tables / iters << " ns" << std::endl;
+}
+
+// random range reads decode only the blocks they overlap
+static void test_container(const std::vector<uint8_t>& sequence, const ContainerParams& params) {
+	using namespace std::chrono;
+
+	constexpr int reads = 100;
+	constexpr size_t read_size = 100;
+
+	auto t1_enc = high_resolution_clock::now();
+	std::vector<uint8_t> container = encode_container(sequence.data(), sequence.size(), params);
+	auto t2_enc = high_resolution_clock::now();
+
+	ContainerReader reader;
+	std::vector<uint8_t> decode_buffer(sequence.size() + 10);
+	auto t1_dec = high_resolution_clock::now();
+	bool ok = reader.open(container.data(), container.size()) && reader.read(0, sequence.size(), decode_buffer.data());
+	auto t2_dec = high_resolution_clock::now();
+	if (!ok || !std::equal(sequence.begin(), sequence.end(), decode_buffer.begin()))
+		std::cout << "ERROR! sequence decompressed incorrectly from the container" << std::endl;
+
+	std::default_random_engine gen;
+	std::uniform_int_distribution<size_t> offsets(0, sequence.size() - read_size);
+	auto t1_reads = high_resolution_clock::now();
+	for (int i = 0; i < reads; i++) {
+		size_t offset = offsets(gen);
+		if (!reader.read(offset, read_size, decode_buffer.data()) || !std::equal(decode_buffer.begin(), decode_buffer.begin() + read_size, sequence.begin() + offset))
+			std::cout << "ERROR! range read incorrectly from the container" << std::endl;
+	}
+	auto t2_reads = high_resolution_clock::now();
+
+	size_t own_models = 0;
+	for (size_t i = 0; i < reader.block_count(); i++)
+		own_models += reader.block(i).model_block == i;
+	std::cout << "Container with " << params.block_size << "-byte blocks: comp/decomp time " << duration_cast<nanoseconds>(t2_enc - t1_enc).count()
+		<< "/" << duration_cast<nanoseconds>(t2_dec - t1_dec).count() << " ns, " << read_size << "-byte read: " << duration_cast<nanoseconds>(t2_reads - t1_reads).count() / reads
+		<< " ns, len: " << container.size() << ", models: " << own_models << "/" << reader.block_count() << std::endl;
+}
+
+// an index entry claiming more bytes than its block holds must fail the read, not walk off the payload
+static void test_container_tampered(const std::vector<uint8_t>& sequence, const ContainerParams& params) {
+	constexpr size_t footer_size = 16;
+
+	// the repeated block reuses the model of the first one, so it has no header to check original_size against
+	std::vector<uint8_t> repeated(sequence.begin(), sequence.begin() + params.block_size);
+	repeated.insert(repeated.end(), repeated.begin(), repeated.end());
+	std::vector<uint8_t> container = encode_container(repeated.data(), repeated.size(), params);
+	ContainerReader reader;
+	const size_t tampered_block = 1;
+	if (!reader.open(container.data(), container.size()) || reader.block_count() != 2 || reader.block(tampered_block).model_block != 0) {
+		std::cout << "ERROR! container to tamper with not coded" << std::endl;
+		return;
+	}
+
+	bool ok = true;
+	for (uint64_t extra : { (uint64_t)1, (uint64_t)params.block_size }) {
+		uint64_t index_offset = reader.block(0).offset;
+		for (size_t i = 0; i < reader.block_count(); i++)
+			index_offset += reader.block(i).compressed_size;
+		std::vector<uint8_t> tampered(container.begin(), container.begin() + index_offset);
+		uint8_t entry[30];
+		for (size_t i = 0; i < reader.block_count(); i++) {
+			const ContainerBlock& b = reader.block(i);
+			uint8_t* end = put_varint(entry, b.compressed_size);
+			end = put_varint(end, b.original_size + (i == tampered_block ? extra : 0));
+			end = put_varint(end, i - b.model_block);
+			tampered.insert(tampered.end(), entry, end);
+		}
+		tampered.insert(tampered.end(), container.end() - footer_size, container.end());
+
+		ContainerReader tampered_reader;
+		std::vector<uint8_t> decode_buffer(repeated.size() + extra);
+		ok &= tampered_reader.open(tampered.data(), tampered.size())
+			&& !tampered_reader.read(0, tampered_reader.original_size(), decode_buffer.data())
+			&& !tampered_reader.decode_block(tampered_block, decode_buffer.data());
+	}
+	if (!ok)
+		std::cout << "ERROR! tampered container index read without an error" << std::endl;
+}
+
+// the coders chosen by the cost model for every goal and the container they give
+static void test_select(const std::vector<uint8_t>& sequence, size_t block_size) {
+	using namespace std::chrono;
+
+	const std::pair<const char*, SelectParams> objectives[] = {
+		{ "min size", { .goal = SELECT_MIN_SIZE } },
+		{ "max speed", { .goal = SELECT_MAX_SPEED } },
+		{ "max encoding speed", { .goal = SELECT_MAX_SPEED, .decode_weight = 0 } },
+		{ "weighted", {} },
+		{ "weighted, 100 ns/byte", { .ns_per_byte = 100 } }
+	};
+	const char* variants[] = { "rANS", "rANS fast", "", "acc " };
+	for (const auto& [objective, select] : objectives) {
+		ContainerParams params = { .block_size = block_size, .select_coders = true, .select = select };
+		auto t1_enc = high_resolution_clock::now();
+		std::vector<uint8_t> container = encode_container(sequence.data(), sequence.size(), params);
+		auto t2_enc = high_resolution_clock::now();
+
+		ContainerReader reader;
+		std::vector<uint8_t> decode_buffer(sequence.size());
+		auto t1_dec = high_resolution_clock::now();
+		bool ok = reader.open(container.data(), container.size()) && reader.read(0, sequence.size(), decode_buffer.data());
+		auto t2_dec = high_resolution_clock::now();
+		if (!ok || decode_buffer != sequence)
+			std::cout << "ERROR! sequence decompressed incorrectly from the container with selected coders" << std::endl;
+
+		// the coders of the blocks with their own model
+		std::vector<std::pair<std::string, int>> coders;
+		for (size_t i = 0; ok && i < reader.block_count(); i++) {
+			StreamHeader header;
+			if (reader.block(i).model_block != i || !read_stream_header(container.data() + reader.block(i).offset, reader.block(i).compressed_size, header))
+				continue;
+			std::string name = variants[header.variant];
+			if (header.variant == STREAM_FIXED_ACCURACY)
+				name += std::to_string(header.accuracy_bits) + " x" + std::to_string(header.ways);
+			auto it = std::find_if(coders.begin(), coders.end(), [&](const auto& coder) { return coder.first == name; });
+			if (it == coders.end())
+				coders.push_back({ name, 1 });
+			else
+				it->second++;
+		}
+
+		std::cout << "Selected coders (" << objective << ") with " << block_size << "-byte blocks: comp/decomp time " << duration_cast<nanoseconds>(t2_enc - t1_enc).count()
+			<< "/" << duration_cast<nanoseconds>(t2_dec - t1_dec).count() << " ns, len: " << container.size() << ", coders:";
+		for (const auto& coder : coders)
+			std::cout << " " << coder.first << " " << coder.second;
+		std::cout << std::endl;
+	}
+}
+
+// incompressible and constant blocks are stored and run-length coded with bypass_modes, the text is coded
+static void test_bypass(const std::vector<uint8_t>& sequence, bool bypass_modes) {
+	using namespace std::chrono;
+
+	constexpr size_t block_size = 4096;
+
+	std::default_random_engine gen;
+	std::uniform_int_distribution<int> dist(0, 255);
+	std::vector<uint8_t> input(sequence.size() * 3);
+	for (size_t i = 0; i < sequence.size(); i++) {
+		input[i] = (uint8_t)dist(gen);
+		input[sequence.size() + i] = 0;
+		input[2 * sequence.size() + i] = sequence[i];
+	}
+
+	ContainerParams params = { .block_size = block_size, .bypass_modes = bypass_modes };
+	auto t1_enc = high_resolution_clock::now();
+	std::vector<uint8_t> container = encode_container(input.data(), input.size(), params);
+	auto t2_enc = high_resolution_clock::now();
+
+	ContainerReader reader;
+	std::vector<uint8_t> decode_buffer(input.size());
+	auto t1_dec = high_resolution_clock::now();
+	bool ok = reader.open(container.data(), container.size()) && reader.read(0, input.size(), decode_buffer.data());
+	auto t2_dec = high_resolution_clock::now();
+	if (!ok || decode_buffer != input)
+		std::cout << "ERROR! sequence decompressed incorrectly from the container" << (bypass_modes ? " with bypass modes" : "") << std::endl;
+
+	size_t stored = 0, runs = 0;
+	for (size_t i = 0; ok && i < reader.block_count(); i++) {
+		StreamHeader header;
+		if (read_stream_header(container.data() + reader.block(i).offset, reader.block(i).compressed_size, header) && reader.block(i).model_block == i) {
+			stored += header.variant == STREAM_STORED;
+			runs += header.variant == STREAM_RLE;
+		}
+	}
+	std::cout << "Random, zero and text " << block_size << "-byte blocks" << (bypass_modes ? " with bypass modes" : "") << ": comp/decomp time "
+		<< duration_cast<nanoseconds>(t2_enc - t1_enc).count() << "/" << duration_cast<nanoseconds>(t2_dec - t1_dec).count()
+		<< " ns, len: " << container.size() << ", stored/RLE blocks: " << stored << "/" << runs << " of " << reader.block_count() << std::endl;
+}
+
+// compression and decompression throughput of a large buffer on 1, 2, 4, ... threads
+static void test_parallel(const std::vector<uint8_t>& sequence, const ContainerParams& params, const char* name) {
+	using namespace std::chrono;
+
+	constexpr size_t copies = 256;
+
+	std::vector<uint8_t> large(sequence.size() * copies);
+	for (size_t i = 0; i < copies; i++)
+		std::copy(sequence.begin(), sequence.end(), large.begin() + i * sequence.size());
+	std::vector<uint8_t> decode_buffer(large.size());
+
+	unsigned max_threads = std::max(1u, std::thread::hardware_concurrency());
+	for (unsigned threads = 1; ; threads = std::min(threads * 2, max_threads)) {
+		ThreadPool pool(threads);
+		auto t1_enc = high_resolution_clock::now();
+		std::vector<uint8_t> container = encode_container(large.data(), large.size(), params, &pool);
+		auto t2_enc = high_resolution_clock::now();
+		ContainerReader reader;
+		bool ok = reader.open(container.data(), container.size());
+		auto t1_dec = high_resolution_clock::now();
+		ok = ok && reader.read(0, large.size(), decode_buffer.data(), &pool);
+		auto t2_dec = high_resolution_clock::now();
+		if (!ok || decode_buffer != large)
+			std::cout << "ERROR! sequence decompressed incorrectly by parallel " << name << std::endl;
+
+		double mb = large.size() / 1e6;
+		std::cout << "Comp/decomp throughput " << name << " on " << threads << " threads: "
+			<< mb / duration<double>(t2_enc - t1_enc).count() << "/" << mb / duration<double>(t2_dec - t1_dec).count()
+			<< " MB/s, compressed len: " << container.size() << std::endl;
+		if (threads == max_threads)
+			break;
+	}
+}
+
+// the sequence is repeated as an endless log stream passed through 4 KB buffers
+static void test_streaming(const std::vector<uint8_t>& sequence, const ContainerParams& params) {
+	using namespace std::chrono;
+
+	constexpr size_t repeats = 64, io_size = 4096;
+
+	StreamEncoder encoder(params);
+	StreamDecoder decoder(params.block_size);
+	uint8_t compressed[io_size], decoded[io_size];
+	uint64_t checked = 0;
+	bool ok = true;
+
+	auto t1 = high_resolution_clock::now();
+	for (size_t r = 0; r <= repeats; r++) {
+		size_t pos = 0;
+		while (r < repeats ? pos < sequence.size() : !encoder.done()) {
+			if (r < repeats)
+				pos += encoder.push(sequence.data() + pos, std::min(io_size, sequence.size() - pos));
+			else
+				encoder.finish();
+			size_t len = encoder.pull(compressed, io_size);
+			for (size_t taken = 0; taken < len && ok; ) {
+				taken += decoder.push(compressed + taken, len - taken);
+				for (size_t got; (got = decoder.pull(decoded, io_size)) > 0; checked += got)
+					ok &= std::equal(decoded, decoded + got, sequence.begin() + checked % sequence.size());
+				ok &= !decoder.failed();
+			}
+		}
+	}
+	auto t2 = high_resolution_clock::now();
+	if (!ok || !decoder.done() || checked != sequence.size() * repeats)
+		std::cout << "ERROR! stream decompressed incorrectly" << std::endl;
+
+	std::cout << "Streaming comp+decomp of " << encoder.total_in() << " bytes in " << params.block_size << "-byte chunks: "
+		<< duration_cast<nanoseconds>(t2 - t1).count() << " ns, compressed len: " << encoder.total_out() << std::endl;
+}
+
+// a frame whose header claims another original size than its payload holds must fail the decoder, not read around it
+static void test_streaming_tampered(const std::vector<uint8_t>& sequence, const ContainerParams& params) {
+	constexpr size_t chunk_size = 4096;
+
+	StreamEncoder encoder(params);
+	encoder.push(sequence.data(), std::min(chunk_size, sequence.size()));
+	encoder.finish();
+	std::vector<uint8_t> stream(2 * chunk_size + MAX_STREAM_HEADER_SIZE);
+	stream.resize(encoder.pull(stream.data(), stream.size()));
+
+	uint64_t frame_size;
+	const uint8_t* frame = get_varint(stream.data(), stream.data() + stream.size(), frame_size);
+	StreamHeader header;
+	size_t header_size = frame ? read_stream_header(frame, frame_size, header) : 0;
+	if (!header_size || !encoder.done()) {
+		std::cout << "ERROR! stream to tamper with not coded" << std::endl;
+		return;
+	}
+
+	bool ok = true;
+	for (uint64_t original_size : { header.original_size - 1, header.original_size + 1, (uint64_t)params.block_size - 1 }) {
+		StreamHeader tampered = header;
+		tampered.original_size = original_size;
+		std::vector<uint8_t> tampered_frame(MAX_STREAM_HEADER_SIZE + header.encoded_size);
+		size_t tampered_size = write_stream_header(tampered, tampered_frame.data());
+		std::copy(frame + header_size, frame + frame_size, tampered_frame.begin() + tampered_size);
+		tampered_frame.resize(tampered_size + header.encoded_size);
+
+		// only the frame is copied so that an over-read of the payload is caught by the sanitizers
+		std::vector<uint8_t> tampered_stream(10);
+		tampered_stream.resize(put_varint(tampered_stream.data(), tampered_frame.size()) - tampered_stream.data());
+		tampered_stream.insert(tampered_stream.end(), tampered_frame.begin(), tampered_frame.end());
+		tampered_stream.push_back(0);
+
+		StreamDecoder decoder(params.block_size);
+		std::vector<uint8_t> decoded(params.block_size);
+		for (size_t taken = 0; taken < tampered_stream.size() && !decoder.failed(); ) {
+			size_t len = decoder.push(tampered_stream.data() + taken, tampered_stream.size() - taken);
+			size_t got = 0;
+			for (size_t pulled; (pulled = decoder.pull(decoded.data(), decoded.size())) > 0; got += pulled) {}
+			if (!len && !got)
+				break;
+			taken += len;
+		}
+		ok &= decoder.failed();
+	}
+	if (!ok)
+		std::cout << "ERROR! tampered stream decoded without an error" << std::endl;
+}
+
+// rans_with_accuracy [source [size]]: the text sample comes from the corpus source (corpus.h), enwiki by default,
+// and all the inputs have size bytes, 64K by default
+int main(int argc, char** argv) {
+	std::vector<size_t> sizes;
+	if (argc > 3 || (argc == 3 && (!parse_sizes(argv[2], sizes) || sizes.size() != 1 || sizes[0] < 4096))) {
+		std::cerr << "usage: rans_with_accuracy [source [size]], size at least 4K" << std::endl;
+		return 2;
+	}
+	std::string error;
+	auto sources = open_sources(argc > 1 ? argv[1] : "enwiki", &error);
+	if (sources.empty()) {
+		std::cerr << error << std::endl;
+		return 1;
+	}
+
+	std::vector<uint8_t> sequence(sizes.empty() ? 1 << 16 : sizes[0]);
 	
 	std::default_random_engine gen;
 
 	std::geometric_distribution<int> dist0(0.7);
-	for (int i = 0; i < sequence.size(); i++)
+	for (size_t i = 0; i < sequence.size(); i++)
 		sequence[i] = dist0(gen) % 256;
-	test_sequence(sequence);
+	test_stream_header(sequence);
 
 	std::geometric_distribution<int> dist1(0.3);
-	for (int i = 0; i < sequence.size(); i++)
+	for (size_t i = 0; i < sequence.size(); i++)
 		sequence[i] = dist1(gen) % 256;
-	test_sequence(sequence);
+	test_stream_header(sequence);
 
 	std::uniform_int_distribution<int> dist2(0, 255);
-	for (int i = 0; i < sequence.size(); i++)
+	for (size_t i = 0; i < sequence.size(); i++)
 		sequence[i] = dist2(gen) % 256;
-	test_sequence(sequence);
+	test_stream_header(sequence);
+
+	sources[0]->fill(sequence.data(), sequence.size());
+	test_stream_header(sequence);
+
+	test_sampled_stats(sequence, { .block_size = 256, .rate = 8 });
+	test_sampled_stats(sequence, { .block_size = 256, .rate = 8, .random = true });
+	test_sampled_stats(sequence, { .block_size = 1024, .rate = 16, .random = true });
+	std::cout << std::endl;
+	test_table_cache(sequence);
+	test_contexts(sequence);
+
+	// the enwiki text between two runs of geometric symbols
+	std::vector<uint8_t> mixed(sequence.size() / 4);
+	for (size_t i = 0; i < mixed.size(); i++)
+		mixed[i] = dist1(gen) % 256;
+	mixed.insert(mixed.end(), sequence.begin(), sequence.end());
+	for (size_t i = 0; i < sequence.size() / 4; i++)
+		mixed.push_back(dist0(gen) % 256);
+	test_adaptive(sequence, {});
+	test_adaptive(mixed, {});
+	test_adaptive(mixed, { .period = 256 });
+	test_adaptive(mixed, { .decay_shift = 40 });
+	test_adaptive(mixed, { .decay_shift = -3 });
+	std::cout << std::endl;
+	test_order1<Order1RansWithAccuracy3>(sequence);
+	test_order1<Order1Rans<12, 3>>(sequence);
+	test_order1<Order1RansWithAccuracy3>(mixed);
+	std::cout << std::endl;
+
+	// token ids and a 12-bit column with geometric ranks
+	std::vector<uint16_t> tokens(sequence.size());
+	std::geometric_distribution<int> dist_tokens(0.002);
+	for (auto& token : tokens)
+		token = (uint16_t)(dist_tokens(gen) * 40503);		// scattered over the alphabet
+	test_wide<Rans16WithAccuracy3>(tokens);
+	std::vector<uint16_t> column(sequence.size());
+	std::geometric_distribution<int> dist_column(0.01);
+	for (auto& value : column)
+		value = (uint16_t)(dist_column(gen) % 4096);
+	test_wide<Rans12WithAccuracy3>(column);
+	std::cout << std::endl;
+	test_container(sequence, { .block_size = 4096 });
+	test_container(sequence, { .block_size = 4096, .share_models = false });
+	test_container(sequence, { .block_size = 16384, .ways = 1 });
+	test_container_tampered(sequence, { .block_size = 4096 });
+	test_container_tampered(sequence, { .block_size = 4096, .variant = STREAM_RANS64 });
+	std::cout << std::endl;
+	test_select(mixed, 1024);
+	test_select(mixed, 16384);
+	std::cout << std::endl;
+	test_bypass(sequence, false);
+	test_bypass(sequence, true);
+	std::cout << std::endl;
+	test_parallel(sequence, { .block_size = 1 << 18, .variant = STREAM_RANS64 }, "rANS");
+	test_parallel(sequence, { .block_size = 1 << 18, .variant = STREAM_RANS64_FAST }, "rANS fast");
+	test_parallel(sequence, { .block_size = 1 << 18, .accuracy_bits = 3 }, "4-way rANS with acc 3");
+	test_parallel(sequence, { .block_size = 1 << 18, .accuracy_bits = 2 }, "4-way rANS with acc 2");
+	std::cout << std::endl;
+	test_streaming(sequence, { .block_size = 1 << 16 });
+	test_streaming(sequence, { .block_size = 1 << 12, .variant = STREAM_RANS64 });
+	test_streaming_tampered(sequence, { .block_size = 1 << 14 });
+	test_streaming_tampered(sequence, { .block_size = 1 << 14, .accuracy_bits = 2, .ways = 1 });
+	test_streaming_tampered(sequence, { .block_size = 1 << 14, .ways = 8 });
+	test_streaming_tampered(sequence, { .block_size = 1 << 14, .variant = STREAM_RANS64 });
+	test_streaming_tampered(sequence, { .block_size = 1 << 14, .variant = STREAM_RANS64_FAST });
+	std::cout << std::endl;
 
-	for (int i = 0; i < sequence.size(); i++)
-		sequence[i] = enwiki16kb[i];
-	test_sequence(sequence);
+	// speed against ratio for STATE_BITS = 10..16 and ACCURACY_BITS = 1..6
+	sweep_fixed_accuracy(sequence, std::make_integer_sequence<int, 7>());
 
 }
 
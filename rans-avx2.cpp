@@ -0,0 +1,238 @@
+//
+// 8-way interleaved rANS with 32-bit states and 16-bit renormalization, decoded with AVX2 (or one symbol
+// at a time on CPUs without it).
+// Based on the interleaved word-based coder from ryg's rANS implementation
+// https://github.com/rygorous/ryg_rans
+//
+
+#include <stdint.h>
+#include <string.h>
+#include <vector>
+#include <bit>
+
+#include "rans-avx2.h"
+#include "cpu-features.h"
+
+#if RANS_X86
+#include <immintrin.h>
+#endif
+
+static constexpr uint32_t RANS_WORD_L = 1u << 16;
+static constexpr int LANES = 8;
+typedef uint32_t RansWordState;
+
+// the slot entries keep the frequency in 16 bits, so with PROB_BITS = 16 they store freq - 1 for a single symbol
+// with the frequency 1 << 16
+template <int PROB_BITS>
+static constexpr uint32_t FREQ_BIAS = PROB_BITS == 16 ? 1 : 0;
+
+
+//
+// Encoding
+//
+
+static inline void RansWordEncPutSymbol(RansWordState* r, uint16_t** pptr, Rans64EncSymbol const* sym, uint32_t scale_bits) {
+    uint32_t x = *r;
+    uint64_t x_max = ((uint64_t)(RANS_WORD_L >> scale_bits) << 16) * sym->freq;
+    if (x >= x_max) {
+        *pptr -= 1;
+        **pptr = (uint16_t)x;
+        x >>= 16;
+    }
+    *r = ((x / sym->freq) << scale_bits) + (x % sym->freq) + sym->cumm_freq;
+}
+
+template <int PROB_BITS>
+int RansAvx2<PROB_BITS>::encode(std::span<const uint8_t> sequence, std::span<uint8_t> buf, std::span<const Rans64EncSymbol> esyms) {
+    size_t in_size = sequence.size();
+    const uint8_t* in_bytes = sequence.data();
+
+    RansWordState rans[LANES];
+    for (int j = 0; j < LANES; j++)
+        rans[j] = RANS_WORD_L;
+
+    uint8_t* out_end = buf.data() + buf.size();
+    uint16_t* ptr = (uint16_t*)out_end;
+
+    // symbol i is coded by the state i % LANES, the decoder consumes the words in the lane order
+    size_t i = in_size;
+    for (size_t j = in_size % LANES; j > 0; j--) {
+        i--;
+        RansWordEncPutSymbol(&rans[j - 1], &ptr, &esyms[in_bytes[i]], PROB_BITS);
+    }
+    while (i > 0) {
+        for (int j = LANES - 1; j >= 0; j--)
+            RansWordEncPutSymbol(&rans[j], &ptr, &esyms[in_bytes[i - LANES + j]], PROB_BITS);
+        i -= LANES;
+    }
+
+    ptr -= 2 * LANES;
+    memcpy(ptr, rans, sizeof(rans));
+
+    return (int)(out_end - (uint8_t*)ptr);
+}
+
+
+// A symbol adds at most PROB_BITS + log2(1 + freq / x) <= PROB_BITS + 1.5 * 2^(PROB_BITS - 16) bits to its state
+// since x >= freq << (16 - PROB_BITS), every word takes 16 bits out of a state and the final states take 4 bytes each
+template <int PROB_BITS>
+size_t RansAvx2<PROB_BITS>::max_encoded_size(size_t n) {
+    uint64_t bits = (uint64_t)n * PROB_BITS + ((3 * (uint64_t)n >> (17 - PROB_BITS)) + 1);
+    return (size_t)(bits / 16) * 2 + 4 * LANES;
+}
+
+
+//
+// Initialization
+//
+
+template <int PROB_BITS>
+RansAvx2DecTables RansAvx2<PROB_BITS>::init_dec_tables(std::span<const Rans64DecSymbol> dsyms, std::span<const uint8_t> cum2sym) {
+    RansAvx2DecTables tables;
+    init_dec_tables(dsyms, cum2sym, tables);
+    return tables;
+}
+
+template <int PROB_BITS>
+void RansAvx2<PROB_BITS>::init_dec_tables(std::span<const Rans64DecSymbol> dsyms, std::span<const uint8_t> cum2sym, RansAvx2DecTables& tables) {
+    tables.slots.resize(cum2sym.size());
+    tables.cum2sym.resize(cum2sym.size() + 3);
+    for (size_t slot = 0; slot < cum2sym.size(); slot++) {
+        const Rans64DecSymbol& sym = dsyms[cum2sym[slot]];
+        tables.slots[slot] = (sym.freq - FREQ_BIAS<PROB_BITS>) | ((uint32_t)(slot - sym.start) << 16);
+        tables.cum2sym[slot] = cum2sym[slot];
+    }
+}
+
+
+//
+// Decoding
+//
+
+// a truncated stream decodes to garbage but is never read past end
+template <int PROB_BITS>
+static inline void RansWordDecSymbol(RansWordState* r, const uint16_t** pptr, const uint16_t* end, const RansAvx2DecTables& tables, uint8_t* out) {
+    uint32_t x = *r;
+    uint32_t slot = x & ((1u << PROB_BITS) - 1);
+    uint32_t entry = tables.slots[slot];
+    *out = tables.cum2sym[slot];
+    x = ((entry & 0xFFFF) + FREQ_BIAS<PROB_BITS>) * (x >> PROB_BITS) + (entry >> 16);
+    if (x < RANS_WORD_L && *pptr < end) {
+        x = (x << 16) | **pptr;
+        *pptr += 1;
+    }
+    *r = x;
+}
+
+// the same stream decoded one symbol at a time, for CPUs without AVX2
+template <int PROB_BITS>
+static void decode_scalar(const RansAvx2DecTables& tables, const uint8_t* rans_begin, const uint8_t* rans_end,
+    uint8_t* dec_bytes, size_t original_size
+) {
+    const uint16_t* ptr = (const uint16_t*)rans_begin;
+    const uint16_t* end = (const uint16_t*)rans_end;
+    RansWordState rans[LANES];
+    memcpy(rans, ptr, sizeof(rans));
+    ptr += 2 * LANES;
+
+    for (size_t i = 0; i < original_size; i++)
+        RansWordDecSymbol<PROB_BITS>(&rans[i % LANES], &ptr, end, tables, dec_bytes + i);
+}
+
+#if RANS_X86
+// for every renormalization mask, the lane k takes the word number popcount(mask & ((1 << k) - 1))
+struct RenormPermutations {
+    alignas(32) uint32_t idx[256][LANES];
+
+    RenormPermutations() {
+        for (int mask = 0; mask < 256; mask++) {
+            int count = 0;
+            for (int k = 0; k < LANES; k++) {
+                idx[mask][k] = count;
+                if (mask & (1 << k))
+                    count++;
+            }
+        }
+    }
+};
+
+static const RenormPermutations renorm_permutations;
+
+template <int PROB_BITS>
+TARGET_AVX2
+static void decode_avx2(const RansAvx2DecTables& tables, const uint8_t* rans_begin, const uint8_t* rans_end,
+    uint8_t* dec_bytes, size_t original_size
+) {
+    const uint16_t* ptr = (const uint16_t*)rans_begin;
+    const uint16_t* end = (const uint16_t*)rans_end;
+    __m256i x = _mm256_loadu_si256((const __m256i*)ptr);
+    ptr += 2 * LANES;
+
+    const int* slots_data = (const int*)tables.slots.data();
+    const int* cum2sym_data = (const int*)tables.cum2sym.data();
+    const __m256i slot_mask = _mm256_set1_epi32((1 << PROB_BITS) - 1);
+    const __m256i low16_mask = _mm256_set1_epi32(0xFFFF);
+    const __m256i byte_mask = _mm256_set1_epi32(0xFF);
+    const __m256i pack_bytes = _mm256_setr_epi8(0, 4, 8, 12, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+        0, 4, 8, 12, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1);
+    const __m256i pack_lanes = _mm256_setr_epi32(0, 4, 1, 1, 1, 1, 1, 1);
+
+    size_t i = 0;
+    // a group reads at most LANES words, the last groups are decoded by the scalar loop to stay inside the stream
+    for (; i + LANES <= original_size && end - ptr >= LANES; i += LANES) {
+        __m256i slot = _mm256_and_si256(x, slot_mask);
+        __m256i entry = _mm256_i32gather_epi32(slots_data, slot, 4);
+        __m256i sym = _mm256_and_si256(_mm256_i32gather_epi32(cum2sym_data, slot, 1), byte_mask);
+
+        sym = _mm256_permutevar8x32_epi32(_mm256_shuffle_epi8(sym, pack_bytes), pack_lanes);
+        _mm_storel_epi64((__m128i*)(dec_bytes + i), _mm256_castsi256_si128(sym));
+
+        __m256i freq = _mm256_and_si256(entry, low16_mask);
+        __m256i bias = _mm256_srli_epi32(entry, 16);
+        __m256i high = _mm256_srli_epi32(x, PROB_BITS);
+        x = _mm256_add_epi32(_mm256_mullo_epi32(freq, high), bias);
+        if constexpr (FREQ_BIAS<PROB_BITS> != 0)
+            x = _mm256_add_epi32(x, high);
+
+        __m256i need_renorm = _mm256_cmpeq_epi32(_mm256_srli_epi32(x, 16), _mm256_setzero_si256());
+        int mask = _mm256_movemask_ps(_mm256_castsi256_ps(need_renorm));
+        __m256i words = _mm256_cvtepu16_epi32(_mm_loadu_si128((const __m128i*)ptr));
+        __m256i perm = _mm256_load_si256((const __m256i*)renorm_permutations.idx[mask]);
+        words = _mm256_permutevar8x32_epi32(words, perm);
+        x = _mm256_blendv_epi8(x, _mm256_or_si256(_mm256_slli_epi32(x, 16), words), need_renorm);
+        ptr += std::popcount((unsigned)mask);
+    }
+
+    RansWordState rans[LANES];
+    _mm256_storeu_si256((__m256i*)rans, x);
+    for (; i < original_size; i++)
+        RansWordDecSymbol<PROB_BITS>(&rans[i % LANES], &ptr, end, tables, dec_bytes + i);
+}
+#endif
+
+typedef void (*DecodeKernel)(const RansAvx2DecTables&, const uint8_t*, const uint8_t*, uint8_t*, size_t);
+
+template <int PROB_BITS>
+void RansAvx2<PROB_BITS>::decode(const RansAvx2DecTables& tables, const uint8_t* rans_begin, const uint8_t* rans_end,
+    uint8_t* dec_bytes, size_t original_size
+) {
+#if RANS_X86
+    static const DecodeKernel kernel = cpu_level() >= CPU_AVX2 ? decode_avx2<PROB_BITS> : decode_scalar<PROB_BITS>;
+#else
+    static const DecodeKernel kernel = decode_scalar<PROB_BITS>;
+#endif
+    kernel(tables, rans_begin, rans_end, dec_bytes, original_size);
+}
+
+
+//
+// Explicit instantiations
+//
+
+template struct RansAvx2<10>;
+template struct RansAvx2<11>;
+template struct RansAvx2<12>;
+template struct RansAvx2<13>;
+template struct RansAvx2<14>;
+template struct RansAvx2<15>;
+template struct RansAvx2<16>;
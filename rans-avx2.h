@@ -0,0 +1,58 @@
+//
+// 8-way interleaved rANS with 32-bit states and 16-bit renormalization, decoded with AVX2 (or one symbol
+// at a time on CPUs without it).
+// Based on the interleaved word-based coder from ryg's rANS implementation
+// https://github.com/rygorous/ryg_rans
+//
+
+#pragma once
+
+#include <vector>
+#include <stdint.h>
+
+#include "rans.h"
+
+typedef struct {
+    std::vector<uint32_t> slots;    // freq | (slot - start) << 16 (freq - 1 for PROB_BITS = 16), indexed by the slot
+    std::vector<uint8_t> cum2sym;   // padded for 32-bit gathers
+} RansAvx2DecTables;
+
+// 8-way interleaved rANS with the probabilities in PROB_BITS bits, explicitly instantiated for PROB_BITS = 10..16
+template <int PROB_BITS>
+struct RansAvx2 {
+    static_assert(PROB_BITS >= 10 && PROB_BITS <= 16, "Renormalization reads 16-bit words");
+
+    // the tables are the ones from Rans64<PROB_BITS>::init
+    static RansAvx2DecTables init_dec_tables(std::span<const Rans64DecSymbol> dsyms, std::span<const uint8_t> cum2sym);
+    // rebuilds the tables in place, the vectors keep their storage between messages
+    static void init_dec_tables(std::span<const Rans64DecSymbol> dsyms, std::span<const uint8_t> cum2sym, RansAvx2DecTables& tables);
+    // the largest output of encode for n symbols
+    static size_t max_encoded_size(size_t n);
+    static int encode(std::span<const uint8_t> sequence, std::span<uint8_t> buf, std::span<const Rans64EncSymbol> esyms);
+    // uses AVX2 only when cpu_level() reports it, and never reads at or past rans_end
+    static void decode(const RansAvx2DecTables& tables, const uint8_t* rans_begin, const uint8_t* rans_end,
+        uint8_t* dec_bytes, size_t original_size);
+};
+
+// the tables are the ones from init_rANS
+inline RansAvx2DecTables init_rANS_avx2_dec_tables(std::span<const Rans64DecSymbol> dsyms, std::span<const uint8_t> cum2sym) {
+    return RansAvx2<RANS64_PROB_BITS>::init_dec_tables(dsyms, cum2sym);
+}
+
+inline void init_rANS_avx2_dec_tables(std::span<const Rans64DecSymbol> dsyms, std::span<const uint8_t> cum2sym, RansAvx2DecTables& tables) {
+    RansAvx2<RANS64_PROB_BITS>::init_dec_tables(dsyms, cum2sym, tables);
+}
+
+inline size_t max_encoded_size_rANS_avx2(size_t n) {
+    return RansAvx2<RANS64_PROB_BITS>::max_encoded_size(n);
+}
+
+inline int encode_rANS_avx2(std::span<const uint8_t> sequence, std::span<uint8_t> buf, std::span<const Rans64EncSymbol> esyms) {
+    return RansAvx2<RANS64_PROB_BITS>::encode(sequence, buf, esyms);
+}
+
+inline void decode_rANS_avx2(const RansAvx2DecTables& tables, const uint8_t* rans_begin, const uint8_t* rans_end,
+    uint8_t* dec_bytes, size_t original_size
+) {
+    RansAvx2<RANS64_PROB_BITS>::decode(tables, rans_begin, rans_end, dec_bytes, original_size);
+}
@@ -0,0 +1,194 @@
+//
+// Command-line compressor/decompressor over memory-mapped files (POSIX):
+//
+// rans-cli c [-v rans|rans-fast|acc3|acc2|auto] [-o size|speed|ns_per_byte] [-b block_size] [-w ways] [-t threads] input output
+// rans-cli d [-t threads] input output
+//
+// The input is encoded from its mapping into the container (block-container.h) written through the mapping of
+// the output file, which is sized by max_container_size and truncated afterwards; every block is coded into a
+// reused batch buffer and copied once into the mapping. Decoding maps the container and decodes the blocks
+// directly into the mapped output. With -v auto every block gets the coder
+// chosen by the cost model (coder-select.h) for the objective of -o: the smallest output, the fastest coding or
+// the fastest coding with every output byte worth ns_per_byte nanoseconds (2 by default).
+//
+
+#include <iostream>
+#include <chrono>
+#include <cmath>
+#include <string>
+#include <ctype.h>
+#include <errno.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "block-container.h"
+#include "thread-pool.h"
+
+struct MappedFile {
+    int fd = -1;
+    uint8_t* data = nullptr;
+    size_t size = 0;
+
+    ~MappedFile() {
+        if (data)
+            munmap(data, size);
+        if (fd >= 0)
+            close(fd);
+    }
+
+    bool open_read(const char* path) {
+        struct stat st;
+        if ((fd = open(path, O_RDONLY)) < 0 || fstat(fd, &st) < 0)
+            return false;
+        size = (size_t)st.st_size;
+        if (size == 0)
+            return true;
+        void* ptr = mmap(nullptr, size, PROT_READ, MAP_SHARED, fd, 0);
+        if (ptr == MAP_FAILED)
+            return false;
+        data = (uint8_t*)ptr;
+        madvise(data, size, MADV_SEQUENTIAL);
+        return true;
+    }
+
+    bool open_write(const char* path, size_t new_size) {
+        if ((fd = open(path, O_RDWR | O_CREAT | O_TRUNC, 0644)) < 0 || ftruncate(fd, (off_t)new_size) < 0)
+            return false;
+        size = new_size;
+        if (size == 0)
+            return true;
+        void* ptr = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+        if (ptr == MAP_FAILED)
+            return false;
+        data = (uint8_t*)ptr;
+        return true;
+    }
+
+    // unmaps the file and cuts it to new_size
+    bool truncate(size_t new_size) {
+        if (data)
+            munmap(data, size);
+        data = nullptr;
+        size = 0;
+        return ftruncate(fd, (off_t)new_size) == 0;
+    }
+};
+
+// the strtod of the whole string, false if it is not a finite number
+static bool parse_number(const std::string& text, double& value) {
+    char* end;
+    value = strtod(text.c_str(), &end);
+    return !text.empty() && *end == 0 && std::isfinite(value);
+}
+
+// the strtoull of the whole string, false if it is not a decimal count up to max
+static bool parse_count(const std::string& text, uint64_t max, uint64_t& value) {
+    char* end;
+    errno = 0;
+    value = strtoull(text.c_str(), &end, 10);
+    return !text.empty() && isdigit((unsigned char)text[0]) && *end == 0 && errno == 0 && value <= max;
+}
+
+static int usage() {
+    std::cerr << "usage: rans-cli c [-v rans|rans-fast|acc3|acc2|auto] [-o size|speed|ns_per_byte] [-b block_size] [-w ways] [-t threads] input output" << std::endl
+              << "       rans-cli d [-t threads] input output" << std::endl;
+    return 2;
+}
+
+int main(int argc, char** argv) {
+    using namespace std::chrono;
+
+    if (argc < 2 || (strcmp(argv[1], "c") != 0 && strcmp(argv[1], "d") != 0))
+        return usage();
+    bool compress = argv[1][0] == 'c';
+
+    ContainerParams params;
+    unsigned threads = 0;
+    uint64_t number;
+    int arg = 2;
+    for (; arg + 1 < argc && argv[arg][0] == '-'; arg += 2) {
+        std::string option = argv[arg], value = argv[arg + 1];
+        if (option == "-v" && value == "rans") {
+            params.variant = STREAM_RANS64;
+        } else if (option == "-v" && value == "rans-fast") {
+            params.variant = STREAM_RANS64_FAST;
+        } else if (option == "-v" && (value == "acc3" || value == "acc2")) {
+            params.variant = STREAM_FIXED_ACCURACY;
+            params.accuracy_bits = value == "acc3" ? 3 : 2;
+        } else if (option == "-v" && value == "auto") {
+            params.select_coders = true;
+        } else if (option == "-o" && (value == "size" || value == "speed")) {
+            params.select.goal = value == "size" ? SELECT_MIN_SIZE : SELECT_MAX_SPEED;
+        } else if (option == "-o" && parse_number(value, params.select.ns_per_byte) && params.select.ns_per_byte >= 0) {
+            params.select.goal = SELECT_WEIGHTED;
+        } else if (option == "-b" && parse_count(value, SIZE_MAX, number) && number > 0) {
+            params.block_size = (size_t)number;
+        } else if (option == "-w" && parse_count(value, 8, number)) {
+            params.ways = (int)number;
+        } else if (option == "-t" && parse_count(value, 1024, number)) {
+            threads = (unsigned)number;
+        } else {
+            return usage();
+        }
+    }
+    if (arg + 2 != argc)
+        return usage();
+    if (compress && !supported_container_params(params)) {
+        std::cerr << "-w must be 1, 2, 4 or 8" << std::endl;
+        return usage();
+    }
+    const char* input_path = argv[arg];
+    const char* output_path = argv[arg + 1];
+
+    MappedFile input, output;
+    if (!input.open_read(input_path)) {
+        std::cerr << "cannot map " << input_path << ": " << strerror(errno) << std::endl;
+        return 1;
+    }
+    ThreadPool pool(threads);
+
+    auto t1 = high_resolution_clock::now();
+    size_t output_size;
+    if (compress) {
+        if (!output.open_write(output_path, max_container_size(input.size, params))) {
+            std::cerr << "cannot map " << output_path << ": " << strerror(errno) << std::endl;
+            return 1;
+        }
+        output_size = encode_container(input.data, input.size, params, output.data, output.size, &pool);
+        if (output_size == 0) {
+            std::cerr << "encoding failed" << std::endl;
+            return 1;
+        }
+    } else {
+        ContainerReader reader;
+        if (!reader.open(input.data, input.size)) {
+            std::cerr << input_path << " is not a valid container" << std::endl;
+            return 1;
+        }
+        output_size = reader.original_size();
+        if (!output.open_write(output_path, output_size)) {
+            std::cerr << "cannot map " << output_path << ": " << strerror(errno) << std::endl;
+            return 1;
+        }
+        if (!reader.read(0, output_size, output.data, &pool)) {
+            std::cerr << input_path << " is corrupted" << std::endl;
+            return 1;
+        }
+    }
+    if (!output.truncate(output_size)) {
+        std::cerr << "cannot write " << output_path << ": " << strerror(errno) << std::endl;
+        return 1;
+    }
+    auto t2 = high_resolution_clock::now();
+
+    double seconds = duration<double>(t2 - t1).count();
+    size_t original_size = compress ? input.size : output_size;
+    std::cerr << input.size << " -> " << output_size << " bytes in " << seconds << " s, "
+              << original_size / 1e6 / seconds << " MB/s on " << pool.size() << " threads" << std::endl;
+    return 0;
+}
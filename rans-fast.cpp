@@ -4,10 +4,12 @@
 //
 
 #include <stdint.h>
+#include <string.h>
 #include <vector>
 
 #include "rans-fast.h"
 #include "sym-stats.h"
+#include "cpu-features.h"
 
 #if defined(_MSC_VER)
 #include <intrin.h>
@@ -21,7 +23,6 @@ static inline uint64_t Rans64MulHi(uint64_t a, uint64_t b) {
 #endif
 
 static constexpr uint64_t RANS64_L = 1ull << 31;
-static constexpr uint32_t prob_bits = 14;
 typedef uint64_t Rans64State;
 
 
@@ -29,12 +30,19 @@ typedef uint64_t Rans64State;
 // Rncoding
 //
 
+// FRONT writes the words forward from the start of the buffer, the decoder then reads them back from the end
+template <bool FRONT>
 static inline void Rans64EncPutSymbol(Rans64State* r, uint32_t** pptr, RansFast64EncSymbol const* sym, uint32_t scale_bits) {
     uint64_t x = *r;
     uint64_t x_max = ((RANS64_L >> scale_bits) << 32) * sym->freq;
     if (x >= x_max) {
-        *pptr -= 1;
-        **pptr = (uint32_t)x;
+        if (FRONT) {
+            **pptr = (uint32_t)x;
+            *pptr += 1;
+        } else {
+            *pptr -= 1;
+            **pptr = (uint32_t)x;
+        }
         x >>= 32;
     }
 
@@ -42,12 +50,16 @@ static inline void Rans64EncPutSymbol(Rans64State* r, uint32_t** pptr, RansFast6
     *r = x + sym->bias + q * sym->cmpl_freq;    //*/
 }
 
+template <bool FRONT>
 static inline void Rans64EncFlush(Rans64State* r, uint32_t** pptr) {
     uint64_t x = *r;
 
-    *pptr -= 2;
+    if (!FRONT)
+        *pptr -= 2;
     (*pptr)[0] = (uint32_t)(x >> 0);
     (*pptr)[1] = (uint32_t)(x >> 32);
+    if (FRONT)
+        *pptr += 2;
 }
 
 static inline void Rans64DecSymbolInit(Rans64DecSymbol* s, uint32_t start, uint32_t freq) {
@@ -55,22 +67,52 @@ static inline void Rans64DecSymbolInit(Rans64DecSymbol* s, uint32_t start, uint3
     s->freq = freq;
 }
 
-int encode_rANS_fast(const std::vector<uint8_t>& sequence, std::vector<uint8_t>& buf, const std::vector<RansFast64EncSymbol>& esyms) {
+template <int PROB_BITS, bool FRONT>
+static FORCE_INLINE int encode(std::span<const uint8_t> sequence, std::span<uint8_t> buf, std::span<const RansFast64EncSymbol> esyms) {
     size_t in_size = sequence.size();
     const uint8_t* in_bytes = sequence.data();
 
     Rans64State rans = RANS64_L;
 
+    uint32_t* out_begin = (uint32_t*)buf.data();
     uint32_t* out_end = (uint32_t*)(buf.data() + buf.size());
-    uint32_t* ptr = out_end;
+    uint32_t* ptr = FRONT ? out_begin : out_end;
     for (size_t i = in_size; i > 0; i--) {
         int s = in_bytes[i - 1];
-        Rans64EncPutSymbol(&rans, &ptr, &esyms[s], prob_bits);
+        Rans64EncPutSymbol<FRONT>(&rans, &ptr, &esyms[s], PROB_BITS);
     }
-    Rans64EncFlush(&rans, &ptr);
-    uint32_t* rans_begin = ptr;
+    Rans64EncFlush<FRONT>(&rans, &ptr);
 
-    return (int)((uint8_t*)out_end - (uint8_t*)rans_begin);
+    return FRONT ? (int)((uint8_t*)ptr - (uint8_t*)out_begin) : (int)((uint8_t*)out_end - (uint8_t*)ptr);
+}
+
+// the body compiled for BMI2 shifts by rcp_shift with shrx (and may use mulx), the entry is selected on the first call
+template <int PROB_BITS, bool FRONT>
+static int encode_baseline(std::span<const uint8_t> sequence, std::span<uint8_t> buf, std::span<const RansFast64EncSymbol> esyms) {
+    return encode<PROB_BITS, FRONT>(sequence, buf, esyms);
+}
+
+template <int PROB_BITS, bool FRONT>
+TARGET_BMI2 static int encode_bmi2(std::span<const uint8_t> sequence, std::span<uint8_t> buf, std::span<const RansFast64EncSymbol> esyms) {
+    return encode<PROB_BITS, FRONT>(sequence, buf, esyms);
+}
+
+typedef int (*EncodeKernel)(std::span<const uint8_t>, std::span<uint8_t>, std::span<const RansFast64EncSymbol>);
+
+template <int PROB_BITS, bool FRONT>
+static EncodeKernel encode_kernel() {
+    static const EncodeKernel kernel = cpu_level() >= CPU_BMI2 ? encode_bmi2<PROB_BITS, FRONT> : encode_baseline<PROB_BITS, FRONT>;
+    return kernel;
+}
+
+template <int PROB_BITS>
+int RansFast64<PROB_BITS>::encode(std::span<const uint8_t> sequence, std::span<uint8_t> buf, std::span<const RansFast64EncSymbol> esyms) {
+    return encode_kernel<PROB_BITS, false>()(sequence, buf, esyms);
+}
+
+template <int PROB_BITS>
+int RansFast64<PROB_BITS>::encode_front(std::span<const uint8_t> sequence, std::span<uint8_t> buf, std::span<const RansFast64EncSymbol> esyms) {
+    return encode_kernel<PROB_BITS, true>()(sequence, buf, esyms);
 }
 
 
@@ -106,39 +148,67 @@ static inline void Rans64EncSymbolInit(RansFast64EncSymbol* s, uint32_t start, u
     }
 }
 
-RansFast64SequenceInfo init_rANS_fast(const std::vector<uint8_t>& sequence) {
-    size_t in_size = sequence.size();
-    const uint8_t* in_bytes = sequence.data();
-
-    static const uint32_t prob_scale = 1 << prob_bits;
+template <int PROB_BITS>
+static void count_stats(std::span<const uint8_t> sequence, const SampleParams* sample, SymbolStats& stats) {
+    static const uint32_t prob_scale = 1 << PROB_BITS;
 
-    SymbolStats stats;
-    stats.count_freqs(in_bytes, in_size);
+    if (sample)
+        stats.count_freqs_sampled(sequence.data(), sequence.size(), sample_for_total(*sample, prob_scale));
+    else
+        stats.count_freqs(sequence.data(), sequence.size());
     stats.normalize_freqs(prob_scale);
+}
 
-    std::vector<uint8_t> cum2sym(prob_scale);
+template <int PROB_BITS>
+static void build_tables(const SymbolStats& stats, RansFast64EncSymbol* esyms, Rans64DecSymbol* dsyms, uint8_t* cum2sym) {
     for (int s = 0; s < 256; s++)
-        for (uint32_t i = stats.cum_freqs[s]; i < stats.cum_freqs[s + 1]; i++)
-            cum2sym[i] = s;
+        memset(cum2sym + stats.cum_freqs[s], s, stats.freqs[s]);
 
-    std::vector<RansFast64EncSymbol> esyms(256);
-    std::vector<Rans64DecSymbol> dsyms(256);
     for (int i = 0; i < 256; i++) {
-        Rans64EncSymbolInit(&esyms[i], stats.cum_freqs[i], stats.freqs[i], prob_bits);
+        Rans64EncSymbolInit(&esyms[i], stats.cum_freqs[i], stats.freqs[i], PROB_BITS);
         Rans64DecSymbolInit(&dsyms[i], stats.cum_freqs[i], stats.freqs[i]);
     }
-    return { .esyms = esyms, .dsyms = dsyms, .cum2sym = cum2sym };
 }
 
+template <int PROB_BITS>
+RansFast64SequenceInfo RansFast64<PROB_BITS>::init(std::span<const uint8_t> sequence, const SampleParams* sample) {
+    SymbolStats stats;
+    count_stats<PROB_BITS>(sequence, sample, stats);
+    return init(stats);
+}
 
-//
-// Decoding (the same as in the usual rANS)
-//
+template <int PROB_BITS>
+RansFast64SequenceInfo RansFast64<PROB_BITS>::init(const SymbolStats& stats) {
+    static const uint32_t prob_scale = 1 << PROB_BITS;
 
-#include "rans.h"
+    std::vector<uint8_t> cum2sym(prob_scale);
+    std::vector<RansFast64EncSymbol> esyms(256);
+    std::vector<Rans64DecSymbol> dsyms(256);
+    build_tables<PROB_BITS>(stats, esyms.data(), dsyms.data(), cum2sym.data());
+    return { .esyms = std::move(esyms), .dsyms = std::move(dsyms), .cum2sym = std::move(cum2sym) };
+}
 
-void decode_rANS_fast(const std::vector<Rans64DecSymbol>& dsyms, const std::vector<uint8_t>& cum2sym,
-    const uint8_t* rans_begin, uint8_t* dec_bytes, size_t original_size
-) {
-    decode_rANS(dsyms, cum2sym, rans_begin, dec_bytes, original_size);
+template <int PROB_BITS>
+void RansFast64<PROB_BITS>::Context::init(std::span<const uint8_t> sequence, const SampleParams* sample) {
+    SymbolStats stats;
+    count_stats<PROB_BITS>(sequence, sample, stats);
+    init(stats);
+}
+
+template <int PROB_BITS>
+void RansFast64<PROB_BITS>::Context::init(const SymbolStats& stats) {
+    build_tables<PROB_BITS>(stats, esyms, dsyms, cum2sym);
 }
+
+
+//
+// Explicit instantiations (the decoding is the one of Rans64)
+//
+
+template struct RansFast64<10>;
+template struct RansFast64<11>;
+template struct RansFast64<12>;
+template struct RansFast64<13>;
+template struct RansFast64<14>;
+template struct RansFast64<15>;
+template struct RansFast64<16>;
@@ -25,7 +25,59 @@ typedef struct {
     std::vector<uint8_t> cum2sym;
 } RansFast64SequenceInfo;
 
-RansFast64SequenceInfo init_rANS_fast(const std::vector<uint8_t>& sequence);
-int encode_rANS_fast(const std::vector<uint8_t>& sequence, std::vector<uint8_t>& buf, const std::vector<RansFast64EncSymbol>& esyms);
-void decode_rANS_fast(const std::vector<Rans64DecSymbol>& dsyms, const std::vector<uint8_t>& cum2sym,
-    const uint8_t* rans_begin, uint8_t* dec_bytes, size_t original_size);
+struct SampleParams;
+template <int ALPHABET_SIZE> struct BasicSymbolStats;
+typedef BasicSymbolStats<256> SymbolStats;
+
+// the encoder of Rans64<PROB_BITS> with the divisions replaced by reciprocals, the decoder is the same;
+// explicitly instantiated for PROB_BITS = 10..16
+template <int PROB_BITS>
+struct RansFast64 {
+    static RansFast64SequenceInfo init(std::span<const uint8_t> sequence, const SampleParams* sample = nullptr);
+    // the tables for stats normalized to 1 << PROB_BITS
+    static RansFast64SequenceInfo init(const SymbolStats& stats);
+    static int encode(std::span<const uint8_t> sequence, std::span<uint8_t> buf, std::span<const RansFast64EncSymbol> esyms);
+    // written from the start of buf as Rans64::encode_front, decoded by Rans64::decode_front
+    static int encode_front(std::span<const uint8_t> sequence, std::span<uint8_t> buf, std::span<const RansFast64EncSymbol> esyms);
+    static bool decode(std::span<const Rans64DecSymbol> dsyms, std::span<const uint8_t> cum2sym,
+        const uint8_t* rans_begin, const uint8_t* rans_end, uint8_t* dec_bytes, size_t original_size) {
+        return Rans64<PROB_BITS>::decode(dsyms, cum2sym, rans_begin, rans_end, dec_bytes, original_size);
+    }
+    static size_t max_encoded_size(size_t n) { return Rans64<PROB_BITS>::max_encoded_size(n); }
+
+    // the tables of init in fixed storage that is rebuilt in place
+    struct Context {
+        alignas(64) RansFast64EncSymbol esyms[256];
+        alignas(64) Rans64DecSymbol dsyms[256];
+        alignas(64) uint8_t cum2sym[1 << PROB_BITS];
+
+        void init(std::span<const uint8_t> sequence, const SampleParams* sample = nullptr);
+        void init(const SymbolStats& stats);
+    };
+};
+
+typedef RansFast64<RANS64_PROB_BITS>::Context RansFast64Context;
+
+inline RansFast64SequenceInfo init_rANS_fast(std::span<const uint8_t> sequence, const SampleParams* sample = nullptr) {
+    return RansFast64<RANS64_PROB_BITS>::init(sequence, sample);
+}
+
+// the tables for stats normalized to 1 << RANS64_PROB_BITS
+inline RansFast64SequenceInfo init_rANS_fast(const SymbolStats& stats) {
+    return RansFast64<RANS64_PROB_BITS>::init(stats);
+}
+
+inline int encode_rANS_fast(std::span<const uint8_t> sequence, std::span<uint8_t> buf, std::span<const RansFast64EncSymbol> esyms) {
+    return RansFast64<RANS64_PROB_BITS>::encode(sequence, buf, esyms);
+}
+
+inline bool decode_rANS_fast(std::span<const Rans64DecSymbol> dsyms, std::span<const uint8_t> cum2sym,
+    const uint8_t* rans_begin, const uint8_t* rans_end, uint8_t* dec_bytes, size_t original_size
+) {
+    return RansFast64<RANS64_PROB_BITS>::decode(dsyms, cum2sym, rans_begin, rans_end, dec_bytes, original_size);
+}
+
+// written from the start of buf as encode_rANS_front, decoded by decode_rANS_front
+inline int encode_rANS_fast_front(std::span<const uint8_t> sequence, std::span<uint8_t> buf, std::span<const RansFast64EncSymbol> esyms) {
+    return RansFast64<RANS64_PROB_BITS>::encode_front(sequence, buf, esyms);
+}
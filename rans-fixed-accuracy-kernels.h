@@ -0,0 +1,194 @@
+//
+// The per-symbol steps of the fixed-accuracy coders shared by the static, adaptive and order-1 kernels.
+// BMI2 selects the variant of the bit operations for the kernels compiled with TARGET_BMI2 (cpu-features.h).
+//
+
+#pragma once
+
+#include <bit>
+#include <stdint.h>
+#include <string.h>
+
+#include "sym-stats.h"
+#include "rans-fixed-accuracy.h"
+#include "cpu-features.h"
+
+alignas(128) static const uint32_t bit_masks[] = { 0, 0x1, 0x3, 0x7, 0xF, 0x1F,  0x3F, 0x7F, 0xFF, 0x1FF, 0x3FF,
+	0x7FF, 0xFFF, 0x1FFF, 0x3FFF, 0x7FFF, 0xFFFF, 0x1FFFF, 0x3FFFF, 0x7FFFF, 0xFFFFF, 0x1FFFFF, 0x3FFFFF,
+	0x7FFFFF, 0xFFFFFF, 0x1FFFFFF, 0x3FFFFFF, 0x7FFFFFF, 0xFFFFFFF, 0x1FFFFFFF, 0x3FFFFFFF, 0x7FFFFFFF };
+
+
+
+//
+// Encoding
+//
+
+// the low count bits: BMI2 takes them with bzhi instead of the table lookup
+template <bool BMI2>
+static inline uint64_t low_bits(uint64_t bits, int count) {
+	if constexpr (BMI2)
+		return bits & ((1ull << count) - 1);
+	else
+		return bits & bit_masks[count];
+}
+
+template <bool BMI2>
+static inline void emit_bits(uint64_t& output_word, uint8_t& ptr, uint32_t bits, int count) {
+	output_word |= low_bits<BMI2>(bits, count) << ptr;
+	ptr += count;
+}
+
+// the whole word is stored while it fits the buffer, then only the complete bytes
+static inline void flush_bits(uint64_t& output_word, uint8_t& ptr, uint8_t*& buffer, const uint8_t* buffer_end) {
+	int bytes_num = ptr >> 3;
+	if (buffer_end - buffer >= 8)
+		memcpy(buffer, &output_word, sizeof(uint64_t));
+	else
+		memcpy(buffer, &output_word, bytes_num);
+	ptr &= 7;
+	output_word >>= bytes_num << 3;
+	buffer += bytes_num;
+}
+
+template <int ALL_BITS>
+static inline void div_high(uint32_t freq, uint32_t& x, uint32_t& rem, int rem_bit) {
+	uint32_t x_sub = x - (freq << rem_bit);
+	if ((int32_t)x_sub >= 0)
+		x = x_sub;
+	rem |= x_sub & (1 << (rem_bit + ALL_BITS));
+}
+
+// div_high for rem_bit = REM_BIT, ..., 1, 0 unrolled at compile time
+template <int ALL_BITS, int REM_BIT>
+static inline void div_high_cascade(uint32_t freq, uint32_t& x, uint32_t& rem) {
+	if constexpr (REM_BIT >= 0) {
+		div_high<ALL_BITS>(freq, x, rem, REM_BIT);
+		div_high_cascade<ALL_BITS, REM_BIT - 1>(freq, x, rem);
+	}
+}
+
+template <int STATE_BITS, int ACCURACY_BITS, bool BMI2>
+static inline uint32_t encode_symbol(const typename FixedAccuracyRans<STATE_BITS, ACCURACY_BITS>::EncSymInfo& sym_inf, uint32_t x, uint64_t& output_word, uint8_t& ptr) {
+	typedef FixedAccuracyRans<STATE_BITS, ACCURACY_BITS> Rans;
+	uint32_t cumm_freq = sym_inf.cumm_freq;
+	uint32_t freq = sym_inf.freq;
+	uint32_t delta = sym_inf.delta;
+	int shift = (x + delta) >> (Rans::ALL_BITS + 1);			// Collet's trick
+	emit_bits<BMI2>(output_word, ptr, x, shift);
+	x >>= shift;
+	x -= freq << ACCURACY_BITS;
+
+	uint32_t rem = 0;
+	div_high_cascade<Rans::ALL_BITS, ACCURACY_BITS - 1>(freq, x, rem);
+	rem = (rem ^ (Rans::ACCURACY_MASK << Rans::ALL_BITS)) >> ACCURACY_BITS;
+	return x + cumm_freq + rem;
+}
+
+// the last state goes in front of the bits left in output_word, so the decoder starts from it
+static inline void finish_stream(uint32_t x, uint64_t output_word, uint8_t ptr, uint8_t*& buffer) {
+	uint32_t z = (x << ptr) | (uint32_t)output_word;  // after flush_bits at most 7 bits in output_word are used
+	memcpy(buffer, &z, sizeof(uint32_t));
+	buffer += 4;
+}
+
+template <int STATE_BITS, int ACCURACY_BITS>
+static inline void init_enc_symbol(typename FixedAccuracyRans<STATE_BITS, ACCURACY_BITS>::EncSymInfo& esym, uint32_t cumm_freq, uint32_t freq) {
+	typedef FixedAccuracyRans<STATE_BITS, ACCURACY_BITS> Rans;
+	esym.freq = freq;
+	esym.cumm_freq = cumm_freq;
+	uint32_t shift = STATE_BITS - std::bit_width(freq) + 1;
+	esym.delta = (shift << (Rans::ALL_BITS + 1)) - (freq << (shift + ACCURACY_BITS));
+}
+
+
+//
+// Decoding
+//
+
+template <bool BMI2>
+static inline uint32_t read_bits(uint64_t& word, uint8_t& ptr, uint8_t count) {
+	ptr -= count;
+	return (uint32_t)low_bits<BMI2>(word >> ptr, count);
+}
+
+// the stream from begin to end, read backwards from end; the bytes missing before begin read as zeros and are
+// counted in pad_bits, so a decoder that used exactly the bits of the stream is left with pad_bits bits in its word
+struct InputBuffer {
+	const uint8_t* begin;
+	const uint8_t* end;
+	size_t pad_bits;
+};
+
+// the first n < 4 bytes of the stream at the top of the word, zeros below them; kept out of the kernels so that
+// the InputBuffer stays in registers
+static NOINLINE uint32_t read_stream_start(const uint8_t* begin, size_t n) {
+	uint32_t buf = 0;
+	memcpy((uint8_t*)&buf + 4 - n, begin, n);
+	return buf;
+}
+
+// the refills of a kernel that checked the stream has room for all of them are not BOUNDED
+template <int STATE_BITS, bool BOUNDED = true>
+static inline void read_buffer(uint64_t& word, uint8_t& ptr, InputBuffer& in) {
+	if (STATE_BITS > ptr) {
+		uint32_t buf;
+		if (!BOUNDED || in.end - in.begin >= 4) [[likely]] {
+			in.end -= 4;
+			memcpy(&buf, in.end, 4);
+		} else {
+			size_t n = in.end - in.begin;
+			buf = read_stream_start(in.begin, n);
+			in.end = in.begin;
+			in.pad_bits += 32 - 8 * n;
+		}
+		word = (word << 32) | buf;
+		ptr += 32;
+	}
+}
+
+// reads the states written by encode_interleaved: the state 0 terminates the stream, the others follow in the bit stream;
+// false if the stream is shorter than the last state or a state is below 1 << ALL_BITS
+template <int STATE_BITS, int ALL_BITS, int N, bool BMI2>
+static inline bool read_states(uint32_t* x, uint64_t& input_word, uint8_t& ptr, InputBuffer& in) {
+	if (in.end - in.begin < 4)
+		return false;
+	in.end -= 4;
+	memcpy(&x[0], in.end, 4);
+	if (x[0] < (1u << ALL_BITS))
+		return false;
+	uint8_t bit = std::bit_width(x[0]) - 1;
+	ptr = bit - ALL_BITS;
+	input_word = low_bits<BMI2>(x[0], ptr);
+	x[0] = x[0] >> ptr;
+	read_buffer<STATE_BITS>(input_word, ptr, in);
+	for (int j = 1; j < N; j++) {
+		uint32_t high = read_bits<BMI2>(input_word, ptr, ALL_BITS + 1 - STATE_BITS);
+		read_buffer<STATE_BITS>(input_word, ptr, in);
+		x[j] = (high << STATE_BITS) | read_bits<BMI2>(input_word, ptr, STATE_BITS);
+		read_buffer<STATE_BITS>(input_word, ptr, in);
+		if (x[j] < (1u << ALL_BITS))
+			return false;
+	}
+	return true;
+}
+
+// the decoding ended exactly at the start of the stream with the states back at the first state of the encoder,
+// initial is 1 << ALL_BITS or 0 for the states normalized by the table decoders
+template <int N>
+static inline bool stream_used_up(const uint32_t* x, uint32_t initial, uint8_t ptr, const InputBuffer& in) {
+	bool ok = in.end == in.begin && ptr == in.pad_bits;
+	for (int j = 0; j < N; j++)
+		ok &= x[j] == initial;
+	return ok;
+}
+
+// the state after the symbol with the frequency freq at the offset rem inside its slots
+template <int STATE_BITS, int ACCURACY_BITS, bool BMI2, bool BOUNDED = true>
+static inline uint32_t decode_step(uint32_t freq, uint32_t rem, uint32_t x, uint64_t& input_word, uint8_t& ptr, InputBuffer& in) {
+	typedef FixedAccuracyRans<STATE_BITS, ACCURACY_BITS> Rans;
+	uint32_t z = freq * (x >> STATE_BITS) + rem;
+	int shift = Rans::ALL_BITS - (std::bit_width(z) - 1);
+	x = (z << shift) + read_bits<BMI2>(input_word, ptr, shift);
+	read_buffer<STATE_BITS, BOUNDED>(input_word, ptr, in);
+	return x;
+}
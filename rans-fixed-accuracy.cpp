@@ -1,86 +1,95 @@
 #include <vector>
+#include <algorithm>
 #include <bit>
 #include <stdint.h>
+#include <string.h>
 
 #include "sym-stats.h"
 #include "rans-fixed-accuracy.h"
-
-static constexpr int STATE_BITS = 14;	//16;
-static constexpr int ACCURACY_BITS = 3;	// hardcoded and after change first calls to div_high should be removed/added
-static constexpr int ALL_BITS = STATE_BITS + ACCURACY_BITS;
-static constexpr int ACCURACY_MASK = (1 << (ACCURACY_BITS + 1)) - 1;
-static constexpr int STATE_MASK = (1 << STATE_BITS) - 1;
-
-static_assert(STATE_BITS * 3 + ACCURACY_BITS + 8 <= 64, "Ensure three iterations of encode_symbol without flush_bits");
-static_assert(ALL_BITS < 32 - 7, "");
-
-alignas(128) static const uint32_t bit_masks[] = { 0, 0x1, 0x3, 0x7, 0xF, 0x1F,  0x3F, 0x7F, 0xFF, 0x1FF, 0x3FF,
-	0x7FF, 0xFFF, 0x1FFF, 0x3FFF, 0x7FFF, 0xFFFF, 0x1FFFF, 0x3FFFF, 0x7FFFF, 0xFFFFF, 0x1FFFFF, 0x3FFFFF,
-	0x7FFFFF, 0xFFFFFF, 0x1FFFFFF, 0x3FFFFFF, 0x7FFFFFF, 0xFFFFFFF, 0x1FFFFFFF, 0x3FFFFFFF, 0x7FFFFFFF };
+#include "rans-fixed-accuracy-kernels.h"
+#include "cpu-features.h"
 
 
 //
 // Encoding
 //
 
-static inline void emit_bits(uint64_t& output_word, uint8_t& ptr, uint32_t bits, int count) {
-	output_word |= (uint64_t)(bits & bit_masks[count]) << ptr;
-	ptr += count;
+template <int STATE_BITS, int ACCURACY_BITS>
+size_t FixedAccuracyRans<STATE_BITS, ACCURACY_BITS>::max_encoded_size(size_t n, int ways) {
+	uint64_t bits = (uint64_t)n * STATE_BITS + (uint64_t)(ways - 1) * (ALL_BITS + 1);
+	return (size_t)(bits / 8) + 4;
 }
 
-static inline void flush_bits(uint64_t& output_word, uint8_t& ptr, uint8_t*& buffer) {
-	int bytes_num = ptr >> 3;
-	memcpy(buffer, &output_word, sizeof(uint64_t));
-	ptr &= 7;
-	output_word >>= bytes_num << 3;
-	buffer += bytes_num;
-}
-
-static inline void div_high(uint32_t freq, uint32_t& x, uint32_t& rem, int rem_bit) {
-	uint32_t x_sub = x - (freq << rem_bit);
-	if ((int32_t)x_sub >= 0)
-		x = x_sub;
-	rem |= x_sub & (1 << (rem_bit + ALL_BITS));
-}
+template <int STATE_BITS, int ACCURACY_BITS, bool BMI2>
+static FORCE_INLINE int encode_kernel(std::span<const uint8_t> sequence, std::span<uint8_t> output,
+	std::span<const typename FixedAccuracyRans<STATE_BITS, ACCURACY_BITS>::EncSymInfo> sym_table
+) {
+	constexpr int ALL_BITS = STATE_BITS + ACCURACY_BITS;
+	uint32_t x = 1 << ALL_BITS;
+	uint64_t output_word = 0;
+	uint8_t ptr = 0;		// bit pointer inside the output_word
+	const uint8_t* reverse_seq = sequence.data() + sequence.size();
+	const uint8_t* sequence_data = sequence.data();
+	uint8_t* buffer = output.data();
+	const uint8_t* buffer_end = output.data() + output.size();
 
-static inline uint32_t encode_symbol(const EncSymInfo& sym_inf, uint32_t x, uint64_t& output_word, uint8_t& ptr) {
-	uint32_t cumm_freq = sym_inf.cumm_freq;
-	uint32_t freq = sym_inf.freq;
-	uint32_t delta = sym_inf.delta;
-	int shift = (x + delta) >> (ALL_BITS + 1);			// Collet's trick
-	emit_bits(output_word, ptr, x, shift);
-	x >>= shift;
-	x -= freq << ACCURACY_BITS;
+	while (reverse_seq >= sequence_data + 3) {
+		x = encode_symbol<STATE_BITS, ACCURACY_BITS, BMI2>(sym_table[*--reverse_seq], x, output_word, ptr);
+		x = encode_symbol<STATE_BITS, ACCURACY_BITS, BMI2>(sym_table[*--reverse_seq], x, output_word, ptr);
+		x = encode_symbol<STATE_BITS, ACCURACY_BITS, BMI2>(sym_table[*--reverse_seq], x, output_word, ptr);
+		flush_bits(output_word, ptr, buffer, buffer_end);
+	}
+	while (reverse_seq > sequence_data) {
+		x = encode_symbol<STATE_BITS, ACCURACY_BITS, BMI2>(sym_table[*--reverse_seq], x, output_word, ptr);
+		flush_bits(output_word, ptr, buffer, buffer_end);
+	}
 
-	uint32_t rem = 0;
-	static_assert(ACCURACY_BITS == 3, "To increase/decrease accuracy, more/less div_high should be invoked");
-	div_high(freq, x, rem, 2);
-	div_high(freq, x, rem, 1);
-	div_high(freq, x, rem, 0);
-	rem = (rem ^ (ACCURACY_MASK << ALL_BITS)) >> ACCURACY_BITS;
-	return x + cumm_freq + rem;
+	uint32_t z = (x << ptr) | (uint32_t)output_word;  // after flush_bits at most 7 bits in output_word are used
+	memcpy(buffer, &z, sizeof(uint32_t));
+	buffer += 4;
+	return buffer - output.data();
 }
 
-int encode_rANS_with_accuracy_3(const std::vector<uint8_t>& sequence, std::vector<uint8_t>& output, const std::vector<EncSymInfo>& sym_table) {
-	uint32_t x = 1 << ALL_BITS;
+//
+// Interleaved encoding: symbol i is coded by the state i % N, all states share one bit stream
+//
+
+template <int STATE_BITS, int ACCURACY_BITS, bool BMI2, int N>
+static FORCE_INLINE int encode_interleaved_kernel(std::span<const uint8_t> sequence, std::span<uint8_t> output,
+	std::span<const typename FixedAccuracyRans<STATE_BITS, ACCURACY_BITS>::EncSymInfo> sym_table
+) {
+	constexpr int ALL_BITS = STATE_BITS + ACCURACY_BITS;
+	static_assert(N >= 2 && (N & 1) == 0, "The number of interleaved states should be even");
+	static_assert(STATE_BITS * 2 + 8 <= 64, "Ensure two iterations of encode_symbol without flush_bits");
+	uint32_t x[N];
+	for (int j = 0; j < N; j++)
+		x[j] = 1 << ALL_BITS;
 	uint64_t output_word = 0;
 	uint8_t ptr = 0;		// bit pointer inside the output_word
 	const uint8_t* reverse_seq = sequence.data() + sequence.size();
 	const uint8_t* sequence_data = sequence.data();
 	uint8_t* buffer = output.data();
+	const uint8_t* buffer_end = output.data() + output.size();
 
-	while (reverse_seq >= sequence_data + 3) {
-		x = encode_symbol(sym_table[*--reverse_seq], x, output_word, ptr);
-		x = encode_symbol(sym_table[*--reverse_seq], x, output_word, ptr);
-		x = encode_symbol(sym_table[*--reverse_seq], x, output_word, ptr);
-		flush_bits(output_word, ptr, buffer);
+	for (int j = sequence.size() % N; j-- > 0; ) {
+		x[j] = encode_symbol<STATE_BITS, ACCURACY_BITS, BMI2>(sym_table[*--reverse_seq], x[j], output_word, ptr);
+		flush_bits(output_word, ptr, buffer, buffer_end);
 	}
 	while (reverse_seq > sequence_data) {
-		x = encode_symbol(sym_table[*--reverse_seq], x, output_word, ptr);
-		flush_bits(output_word, ptr, buffer);
+		for (int j = N - 1; j >= 0; j--) {
+			x[j] = encode_symbol<STATE_BITS, ACCURACY_BITS, BMI2>(sym_table[*--reverse_seq], x[j], output_word, ptr);
+			if ((j & 1) == 0)
+				flush_bits(output_word, ptr, buffer, buffer_end);
+		}
 	}
 
-	uint32_t z = (x << ptr) | (uint32_t)output_word;  // after flush_bits at most 7 bits in output_word are used
+	// states 1..N-1 go to the bit stream, the state 0 terminates the stream as in the single-state encoder
+	for (int j = N - 1; j > 0; j--) {
+		emit_bits<BMI2>(output_word, ptr, x[j], STATE_BITS);
+		emit_bits<BMI2>(output_word, ptr, x[j] >> STATE_BITS, ALL_BITS + 1 - STATE_BITS);
+		flush_bits(output_word, ptr, buffer, buffer_end);
+	}
+	uint32_t z = (x[0] << ptr) | (uint32_t)output_word;
 	memcpy(buffer, &z, sizeof(uint32_t));
 	buffer += 4;
 	return buffer - output.data();
@@ -90,26 +99,98 @@ int encode_rANS_with_accuracy_3(const std::vector<uint8_t>& sequence, std::vecto
 // Initialization
 //
 
-SequenceInfo init_rANS_with_accuracy_3(const std::vector<uint8_t>& sequence) {
-	SymbolStats stats;
-	stats.count_freqs(sequence.data(), sequence.size());
+template <int STATE_BITS, int ACCURACY_BITS>
+static void count_stats(std::span<const uint8_t> sequence, const SampleParams* sample, SymbolStats& stats) {
+	if (sample)
+		stats.count_freqs_sampled(sequence.data(), sequence.size(), sample_for_total(*sample, 1 << STATE_BITS));
+	else
+		stats.count_freqs(sequence.data(), sequence.size());
 	stats.normalize_freqs(1 << STATE_BITS);
+}
 
-	std::vector<uint8_t> cum2sym(1 << STATE_BITS);
+template <int STATE_BITS, int ACCURACY_BITS>
+static void build_tables(const SymbolStats& stats, typename FixedAccuracyRans<STATE_BITS, ACCURACY_BITS>::EncSymInfo* esyms,
+	typename FixedAccuracyRans<STATE_BITS, ACCURACY_BITS>::DecSymInfo* dsyms, uint8_t* cum2sym
+) {
 	for (int s = 0; s < 256; s++)
-		for (uint32_t i = stats.cum_freqs[s]; i < stats.cum_freqs[s + 1]; i++)
-			cum2sym[i] = s;
+		memset(cum2sym + stats.cum_freqs[s], s, stats.freqs[s]);
+
+	for (int j = 0; j < 256; j++) {
+		dsyms[j].freq = stats.freqs[j];
+		dsyms[j].cumm_freq = stats.cum_freqs[j];
+		init_enc_symbol<STATE_BITS, ACCURACY_BITS>(esyms[j], stats.cum_freqs[j], stats.freqs[j]);
+	}
+}
+
+template <int STATE_BITS, int ACCURACY_BITS>
+static void build_dec_slots(const typename FixedAccuracyRans<STATE_BITS, ACCURACY_BITS>::DecSymInfo* dsyms, const uint8_t* cum2sym,
+	typename FixedAccuracyRans<STATE_BITS, ACCURACY_BITS>::DecSlotInfo* slots
+) {
+	for (uint32_t y = 0; y < (1u << STATE_BITS); y++) {
+		uint8_t sym = cum2sym[y];
+		slots[y].sym = sym;
+		slots[y].freq = dsyms[sym].freq;
+		slots[y].bias = y - dsyms[sym].cumm_freq;
+		slots[y].bits = std::bit_width((dsyms[sym].freq << ACCURACY_BITS) + slots[y].bias);
+	}
+}
+
+template <int STATE_BITS, int ACCURACY_BITS>
+typename FixedAccuracyRans<STATE_BITS, ACCURACY_BITS>::SequenceInfo FixedAccuracyRans<STATE_BITS, ACCURACY_BITS>::init(std::span<const uint8_t> sequence, const SampleParams* sample) {
+	SymbolStats stats;
+	count_stats<STATE_BITS, ACCURACY_BITS>(sequence, sample, stats);
+	return init(stats);
+}
 
+template <int STATE_BITS, int ACCURACY_BITS>
+typename FixedAccuracyRans<STATE_BITS, ACCURACY_BITS>::SequenceInfo FixedAccuracyRans<STATE_BITS, ACCURACY_BITS>::init(const SymbolStats& stats) {
+	std::vector<uint8_t> cum2sym(1 << STATE_BITS);
 	std::vector<EncSymInfo> esyms(256);
 	std::vector<DecSymInfo> dsyms(256);
+	build_tables<STATE_BITS, ACCURACY_BITS>(stats, esyms.data(), dsyms.data(), cum2sym.data());
+	return { .esyms = std::move(esyms), .dsyms = std::move(dsyms), .cum2sym = std::move(cum2sym) };
+}
 
-	for (int j = 0; j < 256; j++) {
-		dsyms[j].freq = esyms[j].freq = stats.freqs[j];
-		dsyms[j].cumm_freq = esyms[j].cumm_freq = stats.cum_freqs[j];
-		uint32_t shift = STATE_BITS - std::bit_width(esyms[j].freq) + 1;
-		esyms[j].delta = (shift << (ALL_BITS + 1)) - (esyms[j].freq << (shift + ACCURACY_BITS));
+template <int STATE_BITS, int ACCURACY_BITS>
+void FixedAccuracyRans<STATE_BITS, ACCURACY_BITS>::Context::init(std::span<const uint8_t> sequence, const SampleParams* sample) {
+	SymbolStats stats;
+	count_stats<STATE_BITS, ACCURACY_BITS>(sequence, sample, stats);
+	init(stats);
+}
+
+template <int STATE_BITS, int ACCURACY_BITS>
+void FixedAccuracyRans<STATE_BITS, ACCURACY_BITS>::Context::init(const SymbolStats& stats) {
+	build_tables<STATE_BITS, ACCURACY_BITS>(stats, esyms, dsyms, cum2sym);
+}
+
+template <int STATE_BITS, int ACCURACY_BITS>
+void FixedAccuracyRans<STATE_BITS, ACCURACY_BITS>::Context::init_dec_slots() {
+	build_dec_slots<STATE_BITS, ACCURACY_BITS>(dsyms, cum2sym, slots);
+}
+
+template <int STATE_BITS, int ACCURACY_BITS>
+std::vector<typename FixedAccuracyRans<STATE_BITS, ACCURACY_BITS>::DecSlotInfo> FixedAccuracyRans<STATE_BITS, ACCURACY_BITS>::init_dec_slots(
+	std::span<const DecSymInfo> dsyms, std::span<const uint8_t> cum2sym
+) {
+	std::vector<DecSlotInfo> slots(1 << STATE_BITS);
+	build_dec_slots<STATE_BITS, ACCURACY_BITS>(dsyms.data(), cum2sym.data(), slots.data());
+	return slots;
+}
+
+template <int STATE_BITS, int ACCURACY_BITS>
+std::vector<typename FixedAccuracyRans<STATE_BITS, ACCURACY_BITS>::DecStateInfo> FixedAccuracyRans<STATE_BITS, ACCURACY_BITS>::init_dec_states(
+	std::span<const DecSymInfo> dsyms, std::span<const uint8_t> cum2sym
+) {
+	std::vector<DecStateInfo> states(1 << ALL_BITS);
+	for (uint32_t x = 1 << ALL_BITS; x < (2u << ALL_BITS); x++) {
+		uint32_t y = x & STATE_MASK;
+		uint8_t sym = cum2sym[y];
+		uint32_t z = dsyms[sym].freq * (x >> STATE_BITS) + y - dsyms[sym].cumm_freq;
+		uint32_t shift = ALL_BITS - (std::bit_width(z) - 1);
+		DecStateInfo next = (z << shift) - (1 << ALL_BITS);
+		states[x - (1 << ALL_BITS)] = sym | (shift << 8) | (next << 13);
 	}
-	return { .esyms = esyms, .dsyms = dsyms, .cum2sym = cum2sym };
+	return states;
 }
 
 
@@ -117,45 +198,634 @@ SequenceInfo init_rANS_with_accuracy_3(const std::vector<uint8_t>& sequence) {
 // Decoding
 //
 
-static inline uint32_t read_bits(uint64_t& word, uint8_t& ptr, const uint8_t* RESTRICT & buffer_end, uint8_t count) {
-	ptr -= count;
-	return (word >> ptr) & bit_masks[count];
+template <int STATE_BITS, int ACCURACY_BITS, bool BMI2, bool BOUNDED = true>
+static inline uint32_t decode_symbol(const typename FixedAccuracyRans<STATE_BITS, ACCURACY_BITS>::DecSymInfo* dsyms_data, const uint8_t* cum2sym_data,
+	uint32_t x, uint8_t& out, uint64_t& input_word, uint8_t& ptr, InputBuffer& in
+) {
+	typedef FixedAccuracyRans<STATE_BITS, ACCURACY_BITS> Rans;
+	uint32_t y = x & Rans::STATE_MASK;
+
+	int sym = cum2sym_data[y];
+	out = sym;
+
+	return decode_step<STATE_BITS, ACCURACY_BITS, BMI2, BOUNDED>(dsyms_data[sym].freq, y - dsyms_data[sym].cumm_freq, x, input_word, ptr, in);
+}
+
+template <int STATE_BITS, int ACCURACY_BITS, bool BMI2, bool BOUNDED = true>
+static inline uint32_t decode_symbol_fused(const typename FixedAccuracyRans<STATE_BITS, ACCURACY_BITS>::DecSlotInfo* slots_data,
+	uint32_t x, uint8_t& out, uint64_t& input_word, uint8_t& ptr, InputBuffer& in
+) {
+	typedef FixedAccuracyRans<STATE_BITS, ACCURACY_BITS> Rans;
+	const typename Rans::DecSlotInfo& slot = slots_data[x & Rans::STATE_MASK];
+	out = slot.sym;
+
+	uint32_t z = slot.freq * (x >> STATE_BITS) + slot.bias;
+	int shift = Rans::ALL_BITS + 1 - slot.bits - (z >> slot.bits);
+	x = (z << shift) + read_bits<BMI2>(input_word, ptr, shift);
+	read_buffer<STATE_BITS, BOUNDED>(input_word, ptr, in);
+	return x;
 }
 
-static inline void read_buffer(uint64_t& word, uint8_t& ptr, const uint8_t* RESTRICT & buffer_end) {
-	if (STATE_BITS > ptr) {
-		buffer_end -= 4;
-		uint32_t buf;
-		memcpy(&buf, buffer_end, 4);
-		word = (word << 32) | buf;
-		ptr += 32;
+template <int STATE_BITS, int ACCURACY_BITS, bool BMI2, bool BOUNDED = true>
+static inline uint32_t decode_symbol_table(const typename FixedAccuracyRans<STATE_BITS, ACCURACY_BITS>::DecStateInfo* states_data,
+	uint32_t x, uint8_t& out, uint64_t& input_word, uint8_t& ptr, InputBuffer& in
+) {
+	typename FixedAccuracyRans<STATE_BITS, ACCURACY_BITS>::DecStateInfo state = states_data[x];
+	out = (uint8_t)state;
+	x = (uint32_t)(state >> 13) + read_bits<BMI2>(input_word, ptr, (state >> 8) & 31);
+	read_buffer<STATE_BITS, BOUNDED>(input_word, ptr, in);
+	return x;
+}
+
+template <int STATE_BITS, int ACCURACY_BITS, bool BMI2>
+static FORCE_INLINE bool decode_kernel(const typename FixedAccuracyRans<STATE_BITS, ACCURACY_BITS>::DecSymInfo* dsyms_data, const uint8_t* cum2sym_data,
+	const uint8_t* buffer_begin, const uint8_t* buffer_end, uint8_t* out_buf, uint8_t* out_end
+) {
+	constexpr int ALL_BITS = STATE_BITS + ACCURACY_BITS;
+	InputBuffer in = { buffer_begin, buffer_end, 0 };
+	uint32_t x;
+	uint64_t input_word;
+	uint8_t ptr;
+	if (!read_states<STATE_BITS, ALL_BITS, 1, BMI2>(&x, input_word, ptr, in))
+		return false;
+
+	while (out_buf != out_end) {
+		x = decode_symbol<STATE_BITS, ACCURACY_BITS, BMI2>(dsyms_data, cum2sym_data, x, *out_buf, input_word, ptr, in);
+		out_buf++;
 	}
+	return stream_used_up<1>(&x, 1 << ALL_BITS, ptr, in);
 }
 
-void decode_rANS(const DecSymInfo * dsyms_data, const uint8_t * cum2sym_data,
-	const uint8_t* buffer_end, uint8_t* out_buf, uint8_t* out_end
+template <int STATE_BITS, int ACCURACY_BITS, bool BMI2>
+static FORCE_INLINE bool decode_fused_kernel(const typename FixedAccuracyRans<STATE_BITS, ACCURACY_BITS>::DecSlotInfo* slots_data,
+	const uint8_t* buffer_begin, const uint8_t* buffer_end, uint8_t* out_buf, uint8_t* out_end
 ) {
-	buffer_end -= 4;
+	constexpr int ALL_BITS = STATE_BITS + ACCURACY_BITS;
+	InputBuffer in = { buffer_begin, buffer_end, 0 };
 	uint32_t x;
-	memcpy(&x, buffer_end, 4);
-	uint8_t bit = std::bit_width(x) - 1;
-	uint8_t ptr = bit - ALL_BITS;
-	uint64_t input_word = x & bit_masks[ptr];
-	x = x >> ptr;
-	read_buffer(input_word, ptr, buffer_end);
+	uint64_t input_word;
+	uint8_t ptr;
+	if (!read_states<STATE_BITS, ALL_BITS, 1, BMI2>(&x, input_word, ptr, in))
+		return false;
 
 	while (out_buf != out_end) {
-		uint32_t y = x & STATE_MASK;
+		x = decode_symbol_fused<STATE_BITS, ACCURACY_BITS, BMI2>(slots_data, x, *out_buf, input_word, ptr, in);
+		out_buf++;
+	}
+	return stream_used_up<1>(&x, 1 << ALL_BITS, ptr, in);
+}
+
+template <int STATE_BITS, int ACCURACY_BITS, bool BMI2>
+static FORCE_INLINE bool decode_table_kernel(const typename FixedAccuracyRans<STATE_BITS, ACCURACY_BITS>::DecStateInfo* states_data,
+	const uint8_t* buffer_begin, const uint8_t* buffer_end, uint8_t* out_buf, uint8_t* out_end
+) {
+	constexpr int ALL_BITS = STATE_BITS + ACCURACY_BITS;
+	InputBuffer in = { buffer_begin, buffer_end, 0 };
+	uint32_t x;
+	uint64_t input_word;
+	uint8_t ptr;
+	if (!read_states<STATE_BITS, ALL_BITS, 1, BMI2>(&x, input_word, ptr, in))
+		return false;
+	x -= 1 << ALL_BITS;
 
-		int sym = cum2sym_data[y];
-		*out_buf = sym;
+	while (out_buf != out_end) {
+		x = decode_symbol_table<STATE_BITS, ACCURACY_BITS, BMI2>(states_data, x, *out_buf, input_word, ptr, in);
 		out_buf++;
+	}
+	return stream_used_up<1>(&x, 0, ptr, in);
+}
+
+template <int STATE_BITS, int ACCURACY_BITS, bool BMI2, int N>
+static FORCE_INLINE bool decode_interleaved_kernel(const typename FixedAccuracyRans<STATE_BITS, ACCURACY_BITS>::DecSymInfo* dsyms_data, const uint8_t* cum2sym_data,
+	const uint8_t* buffer_begin, const uint8_t* buffer_end, uint8_t* out_buf, uint8_t* out_end
+) {
+	constexpr int ALL_BITS = STATE_BITS + ACCURACY_BITS;
+	InputBuffer in = { buffer_begin, buffer_end, 0 };
+	uint32_t x[N];
+	uint64_t input_word;
+	uint8_t ptr;
+	if (!read_states<STATE_BITS, ALL_BITS, N, BMI2>(x, input_word, ptr, in))
+		return false;
+
+	// a group refills at most N words, the groups near the start of the stream check it on every refill
+	while (out_end - out_buf >= N && in.end - in.begin >= 4 * N) {
+		for (int j = 0; j < N; j++)
+			x[j] = decode_symbol<STATE_BITS, ACCURACY_BITS, BMI2, false>(dsyms_data, cum2sym_data, x[j], out_buf[j], input_word, ptr, in);
+		out_buf += N;
+	}
+	while (out_end - out_buf >= N) {
+		for (int j = 0; j < N; j++)
+			x[j] = decode_symbol<STATE_BITS, ACCURACY_BITS, BMI2>(dsyms_data, cum2sym_data, x[j], out_buf[j], input_word, ptr, in);
+		out_buf += N;
+	}
+	for (int j = 0; out_buf != out_end; j++) {
+		x[j] = decode_symbol<STATE_BITS, ACCURACY_BITS, BMI2>(dsyms_data, cum2sym_data, x[j], *out_buf, input_word, ptr, in);
+		out_buf++;
+	}
+	return stream_used_up<N>(x, 1 << ALL_BITS, ptr, in);
+}
+
+template <int STATE_BITS, int ACCURACY_BITS, bool BMI2, int N>
+static FORCE_INLINE bool decode_fused_interleaved_kernel(const typename FixedAccuracyRans<STATE_BITS, ACCURACY_BITS>::DecSlotInfo* slots_data,
+	const uint8_t* buffer_begin, const uint8_t* buffer_end, uint8_t* out_buf, uint8_t* out_end
+) {
+	constexpr int ALL_BITS = STATE_BITS + ACCURACY_BITS;
+	InputBuffer in = { buffer_begin, buffer_end, 0 };
+	uint32_t x[N];
+	uint64_t input_word;
+	uint8_t ptr;
+	if (!read_states<STATE_BITS, ALL_BITS, N, BMI2>(x, input_word, ptr, in))
+		return false;
+
+	// a group refills at most N words, the groups near the start of the stream check it on every refill
+	while (out_end - out_buf >= N && in.end - in.begin >= 4 * N) {
+		for (int j = 0; j < N; j++)
+			x[j] = decode_symbol_fused<STATE_BITS, ACCURACY_BITS, BMI2, false>(slots_data, x[j], out_buf[j], input_word, ptr, in);
+		out_buf += N;
+	}
+	while (out_end - out_buf >= N) {
+		for (int j = 0; j < N; j++)
+			x[j] = decode_symbol_fused<STATE_BITS, ACCURACY_BITS, BMI2>(slots_data, x[j], out_buf[j], input_word, ptr, in);
+		out_buf += N;
+	}
+	for (int j = 0; out_buf != out_end; j++) {
+		x[j] = decode_symbol_fused<STATE_BITS, ACCURACY_BITS, BMI2>(slots_data, x[j], *out_buf, input_word, ptr, in);
+		out_buf++;
+	}
+	return stream_used_up<N>(x, 1 << ALL_BITS, ptr, in);
+}
+
+template <int STATE_BITS, int ACCURACY_BITS, bool BMI2, int N>
+static FORCE_INLINE bool decode_table_interleaved_kernel(const typename FixedAccuracyRans<STATE_BITS, ACCURACY_BITS>::DecStateInfo* states_data,
+	const uint8_t* buffer_begin, const uint8_t* buffer_end, uint8_t* out_buf, uint8_t* out_end
+) {
+	constexpr int ALL_BITS = STATE_BITS + ACCURACY_BITS;
+	InputBuffer in = { buffer_begin, buffer_end, 0 };
+	uint32_t x[N];
+	uint64_t input_word;
+	uint8_t ptr;
+	if (!read_states<STATE_BITS, ALL_BITS, N, BMI2>(x, input_word, ptr, in))
+		return false;
+	for (int j = 0; j < N; j++)
+		x[j] -= 1 << ALL_BITS;
+
+	// a group refills at most N words, the groups near the start of the stream check it on every refill
+	while (out_end - out_buf >= N && in.end - in.begin >= 4 * N) {
+		for (int j = 0; j < N; j++)
+			x[j] = decode_symbol_table<STATE_BITS, ACCURACY_BITS, BMI2, false>(states_data, x[j], out_buf[j], input_word, ptr, in);
+		out_buf += N;
+	}
+	while (out_end - out_buf >= N) {
+		for (int j = 0; j < N; j++)
+			x[j] = decode_symbol_table<STATE_BITS, ACCURACY_BITS, BMI2>(states_data, x[j], out_buf[j], input_word, ptr, in);
+		out_buf += N;
+	}
+	for (int j = 0; out_buf != out_end; j++) {
+		x[j] = decode_symbol_table<STATE_BITS, ACCURACY_BITS, BMI2>(states_data, x[j], *out_buf, input_word, ptr, in);
+		out_buf++;
+	}
+	return stream_used_up<N>(x, 0, ptr, in);
+}
+
+
+//
+// Adaptive coding: the symbols are coded in chunks, every chunk with the model built from the chunks before it
+//
+
+// the decayed counts of the coded symbols and the frequencies normalized from them, kept equal in the encoder and the decoder
+template <int STATE_BITS>
+struct AdaptiveModel {
+	uint64_t counts[256];
+	uint32_t hist[256];			// the symbols of the current chunk
+	uint32_t freqs[256];
+	uint32_t cum_freqs[257];
+	uint32_t period;			// the size of the current chunk
+	uint32_t max_period;
+	int decay_shift;
+
+	void init(const AdaptiveParams& params) {
+		memset(counts, 0, sizeof(counts));
+		memset(hist, 0, sizeof(hist));
+		for (int s = 0; s < 256; s++)
+			freqs[s] = (1 << STATE_BITS) / 256;
+		calc_cum_freqs();
+		max_period = std::max(params.period, 1u);
+		period = std::clamp(params.first_period, 1u, max_period);
+		// a shift of 64 or more would be undefined for the counts, the encoder and the decoder clamp it the same way
+		decay_shift = std::clamp(params.decay_shift, 0, 16);
+	}
+
+	void update() {
+		add_chunk();
+		normalize();
+	}
+
+	// the counts and the size of the next chunk after the current one, the freqs are left as they are
+	void add_chunk() {
+		for (int s = 0; s < 256; s++) {
+			counts[s] = counts[s] - (counts[s] >> decay_shift) + hist[s];
+			hist[s] = 0;
+		}
+		period = (uint32_t)std::min<uint64_t>(period * 2ull, max_period);
+	}
+
+	// every symbol keeps one slot and the others are shared in proportion to the counts,
+	// the rounding leftover goes to the most frequent symbol
+	void normalize() {
+		constexpr uint32_t spare = (1 << STATE_BITS) - 256;
+		uint64_t total = 0;
+		int top = 0;
+		for (int s = 0; s < 256; s++) {
+			total += counts[s];
+			if (counts[s] > counts[top])
+				top = s;
+		}
+		uint32_t sum = 0;
+		for (int s = 0; s < 256; s++) {
+			freqs[s] = 1 + (uint32_t)(counts[s] * spare / total);
+			sum += freqs[s];
+		}
+		freqs[top] += (1 << STATE_BITS) - sum;
+		calc_cum_freqs();
+	}
+
+	void calc_cum_freqs() {
+		cum_freqs[0] = 0;
+		for (int s = 0; s < 256; s++)
+			cum_freqs[s + 1] = cum_freqs[s] + freqs[s];
+	}
+};
+
+// the chunks between the models kept by the adaptive encoder
+static constexpr size_t ADAPTIVE_SEGMENT = 64;
+
+// the first symbol of every range of 1 << (STATE_BITS - 8) slots: the decoder searches from there instead of
+// rebuilding cum2sym on every update
+template <int STATE_BITS>
+static void build_buckets(const uint32_t* cum_freqs, uint8_t* buckets) {
+	int sym = 0;
+	for (uint32_t b = 0; b < 256; b++) {
+		while (cum_freqs[sym + 1] <= (b << (STATE_BITS - 8)))
+			sym++;
+		buckets[b] = sym;
+	}
+}
+
+template <int STATE_BITS, int ACCURACY_BITS, bool BMI2>
+static FORCE_INLINE int encode_adaptive_kernel(std::span<const uint8_t> sequence, std::span<uint8_t> output, const AdaptiveParams& params) {
+	typedef FixedAccuracyRans<STATE_BITS, ACCURACY_BITS> Rans;
+	constexpr int ALL_BITS = STATE_BITS + ACCURACY_BITS;
+
+	// The chunks are encoded backwards with the models of the decoding order. The forward pass only decays the counts
+	// and keeps the model at the start of every segment of ADAPTIVE_SEGMENT chunks; each segment, from the last one,
+	// is then replayed from its model to get the frequencies of its chunks. That counts every symbol twice, but keeps
+	// about 5 KB per segment (64K symbols at the period 1024) and the frequencies of one segment instead of those of
+	// every chunk.
+	struct Checkpoint {
+		AdaptiveModel<STATE_BITS> model;
+		size_t begin;
+	};
+	std::vector<Checkpoint> checkpoints;
+	AdaptiveModel<STATE_BITS> model;
+	model.init(params);
+	for (size_t begin = 0, c = 0; begin < sequence.size(); c++) {
+		if (c % ADAPTIVE_SEGMENT == 0) {
+			if (c)
+				model.normalize();
+			checkpoints.push_back({ model, begin });
+		}
+		size_t end = begin + std::min<size_t>(model.period, sequence.size() - begin);
+		for (size_t i = begin; i < end; i++)
+			model.hist[sequence[i]]++;
+		model.add_chunk();
+		begin = end;
+	}
+
+	uint32_t x = 1 << ALL_BITS;
+	uint64_t output_word = 0;
+	uint8_t ptr = 0;		// bit pointer inside the output_word
+	const uint8_t* reverse_seq = sequence.data() + sequence.size();
+	uint8_t* buffer = output.data();
+	const uint8_t* buffer_end = output.data() + output.size();
+	typename Rans::EncSymInfo sym_table[256];
+	size_t chunk_begins[ADAPTIVE_SEGMENT];
+	std::vector<typename Rans::freq_t> segment_freqs(ADAPTIVE_SEGMENT * 256);
+
+	for (size_t k = checkpoints.size(); k-- > 0; ) {
+		model = checkpoints[k].model;
+		size_t chunks = 0;
+		for (size_t begin = checkpoints[k].begin; begin < sequence.size() && chunks < ADAPTIVE_SEGMENT; chunks++) {
+			size_t end = begin + std::min<size_t>(model.period, sequence.size() - begin);
+			chunk_begins[chunks] = begin;
+			std::copy(model.freqs, model.freqs + 256, &segment_freqs[chunks * 256]);
+			if (chunks + 1 < ADAPTIVE_SEGMENT && end < sequence.size()) {
+				for (size_t i = begin; i < end; i++)
+					model.hist[sequence[i]]++;
+				model.update();
+			}
+			begin = end;
+		}
+
+		for (size_t c = chunks; c-- > 0; ) {
+			const typename Rans::freq_t* freqs = &segment_freqs[c * 256];
+			uint32_t cumm_freq = 0;
+			for (int s = 0; s < 256; s++) {
+				init_enc_symbol<STATE_BITS, ACCURACY_BITS>(sym_table[s], cumm_freq, freqs[s]);
+				cumm_freq += freqs[s];
+			}
+
+			const uint8_t* chunk_begin = sequence.data() + chunk_begins[c];
+			while (reverse_seq >= chunk_begin + 3) {
+				x = encode_symbol<STATE_BITS, ACCURACY_BITS, BMI2>(sym_table[*--reverse_seq], x, output_word, ptr);
+				x = encode_symbol<STATE_BITS, ACCURACY_BITS, BMI2>(sym_table[*--reverse_seq], x, output_word, ptr);
+				x = encode_symbol<STATE_BITS, ACCURACY_BITS, BMI2>(sym_table[*--reverse_seq], x, output_word, ptr);
+				flush_bits(output_word, ptr, buffer, buffer_end);
+			}
+			while (reverse_seq > chunk_begin) {
+				x = encode_symbol<STATE_BITS, ACCURACY_BITS, BMI2>(sym_table[*--reverse_seq], x, output_word, ptr);
+				flush_bits(output_word, ptr, buffer, buffer_end);
+			}
+		}
+	}
+
+	uint32_t z = (x << ptr) | (uint32_t)output_word;  // after flush_bits at most 7 bits in output_word are used
+	memcpy(buffer, &z, sizeof(uint32_t));
+	buffer += 4;
+	return buffer - output.data();
+}
 
-		uint32_t rem = y - dsyms_data[sym].cumm_freq;
-		uint32_t z = dsyms_data[sym].freq * (x >> STATE_BITS) + rem;
-		int shift = ALL_BITS - (std::bit_width(z) - 1);
-		x = (z << shift) + read_bits(input_word, ptr, buffer_end, shift);
-		read_buffer(input_word, ptr, buffer_end);
+template <int STATE_BITS, int ACCURACY_BITS, bool BMI2>
+static FORCE_INLINE bool decode_adaptive_kernel(const uint8_t* buffer_begin, const uint8_t* buffer_end, uint8_t* out_buf, uint8_t* out_end, const AdaptiveParams& params) {
+	typedef FixedAccuracyRans<STATE_BITS, ACCURACY_BITS> Rans;
+	constexpr int ALL_BITS = STATE_BITS + ACCURACY_BITS;
+
+	InputBuffer in = { buffer_begin, buffer_end, 0 };
+	uint32_t x;
+	uint64_t input_word;
+	uint8_t ptr;
+	if (!read_states<STATE_BITS, ALL_BITS, 1, BMI2>(&x, input_word, ptr, in))
+		return false;
+
+	AdaptiveModel<STATE_BITS> model;
+	model.init(params);
+	uint8_t buckets[256];
+	build_buckets<STATE_BITS>(model.cum_freqs, buckets);
+
+	while (out_buf != out_end) {
+		uint8_t* chunk_end = out_buf + std::min<size_t>(model.period, out_end - out_buf);
+		for (; out_buf != chunk_end; out_buf++) {
+			uint32_t y = x & Rans::STATE_MASK;
+			uint32_t sym = buckets[y >> (STATE_BITS - 8)];
+			while (model.cum_freqs[sym + 1] <= y)
+				sym++;
+			*out_buf = sym;
+			model.hist[sym]++;
+			x = decode_step<STATE_BITS, ACCURACY_BITS, BMI2>(model.freqs[sym], y - model.cum_freqs[sym], x, input_word, ptr, in);
+		}
+		if (out_buf != out_end) {
+			model.update();
+			build_buckets<STATE_BITS>(model.cum_freqs, buckets);
+		}
 	}
+	return stream_used_up<1>(&x, 1 << ALL_BITS, ptr, in);
+}
+
+
+//
+// Dispatch: every kernel is compiled for the baseline and for BMI2, where bzhi and shlx/shrx replace the bit_masks
+// lookups and the variable shifts (the AVX2 level has no vector kernel here and uses BMI2); the table for the CPU
+// is selected on the first call
+//
+
+// N = 1 is the single-state coder
+template <int STATE_BITS, int ACCURACY_BITS, bool BMI2, int N>
+static FORCE_INLINE int encode_ways(std::span<const uint8_t> sequence, std::span<uint8_t> output,
+	std::span<const typename FixedAccuracyRans<STATE_BITS, ACCURACY_BITS>::EncSymInfo> sym_table
+) {
+	if constexpr (N == 1)
+		return encode_kernel<STATE_BITS, ACCURACY_BITS, BMI2>(sequence, output, sym_table);
+	else
+		return encode_interleaved_kernel<STATE_BITS, ACCURACY_BITS, BMI2, N>(sequence, output, sym_table);
+}
+
+template <int STATE_BITS, int ACCURACY_BITS, bool BMI2, int N>
+static FORCE_INLINE bool decode_ways(const typename FixedAccuracyRans<STATE_BITS, ACCURACY_BITS>::DecSymInfo* dsyms_data, const uint8_t* cum2sym_data,
+	const uint8_t* buffer_begin, const uint8_t* buffer_end, uint8_t* out_buf, uint8_t* out_end
+) {
+	if constexpr (N == 1)
+		return decode_kernel<STATE_BITS, ACCURACY_BITS, BMI2>(dsyms_data, cum2sym_data, buffer_begin, buffer_end, out_buf, out_end);
+	else
+		return decode_interleaved_kernel<STATE_BITS, ACCURACY_BITS, BMI2, N>(dsyms_data, cum2sym_data, buffer_begin, buffer_end, out_buf, out_end);
+}
+
+template <int STATE_BITS, int ACCURACY_BITS, bool BMI2, int N>
+static FORCE_INLINE bool decode_fused_ways(const typename FixedAccuracyRans<STATE_BITS, ACCURACY_BITS>::DecSlotInfo* slots_data,
+	const uint8_t* buffer_begin, const uint8_t* buffer_end, uint8_t* out_buf, uint8_t* out_end
+) {
+	if constexpr (N == 1)
+		return decode_fused_kernel<STATE_BITS, ACCURACY_BITS, BMI2>(slots_data, buffer_begin, buffer_end, out_buf, out_end);
+	else
+		return decode_fused_interleaved_kernel<STATE_BITS, ACCURACY_BITS, BMI2, N>(slots_data, buffer_begin, buffer_end, out_buf, out_end);
+}
+
+template <int STATE_BITS, int ACCURACY_BITS, bool BMI2, int N>
+static FORCE_INLINE bool decode_table_ways(const typename FixedAccuracyRans<STATE_BITS, ACCURACY_BITS>::DecStateInfo* states_data,
+	const uint8_t* buffer_begin, const uint8_t* buffer_end, uint8_t* out_buf, uint8_t* out_end
+) {
+	if constexpr (N == 1)
+		return decode_table_kernel<STATE_BITS, ACCURACY_BITS, BMI2>(states_data, buffer_begin, buffer_end, out_buf, out_end);
+	else
+		return decode_table_interleaved_kernel<STATE_BITS, ACCURACY_BITS, BMI2, N>(states_data, buffer_begin, buffer_end, out_buf, out_end);
 }
 
+// the entry points: the kernels are inlined into them and compiled for their instruction set
+template <bool BMI2>
+struct KernelEntries;
+
+template <>
+struct KernelEntries<false> {
+	template <int S, int A, int N>
+	static int encode(std::span<const uint8_t> sequence, std::span<uint8_t> output, std::span<const typename FixedAccuracyRans<S, A>::EncSymInfo> sym_table) {
+		return encode_ways<S, A, false, N>(sequence, output, sym_table);
+	}
+	template <int S, int A, int N>
+	static bool decode(const typename FixedAccuracyRans<S, A>::DecSymInfo* dsyms_data, const uint8_t* cum2sym_data, const uint8_t* buffer_begin, const uint8_t* buffer_end, uint8_t* out_buf, uint8_t* out_end) {
+		return decode_ways<S, A, false, N>(dsyms_data, cum2sym_data, buffer_begin, buffer_end, out_buf, out_end);
+	}
+	template <int S, int A, int N>
+	static bool decode_fused(const typename FixedAccuracyRans<S, A>::DecSlotInfo* slots_data, const uint8_t* buffer_begin, const uint8_t* buffer_end, uint8_t* out_buf, uint8_t* out_end) {
+		return decode_fused_ways<S, A, false, N>(slots_data, buffer_begin, buffer_end, out_buf, out_end);
+	}
+	template <int S, int A, int N>
+	static bool decode_table(const typename FixedAccuracyRans<S, A>::DecStateInfo* states_data, const uint8_t* buffer_begin, const uint8_t* buffer_end, uint8_t* out_buf, uint8_t* out_end) {
+		return decode_table_ways<S, A, false, N>(states_data, buffer_begin, buffer_end, out_buf, out_end);
+	}
+	template <int S, int A>
+	static int encode_adaptive(std::span<const uint8_t> sequence, std::span<uint8_t> output, const AdaptiveParams& params) {
+		return encode_adaptive_kernel<S, A, false>(sequence, output, params);
+	}
+	template <int S, int A>
+	static bool decode_adaptive(const uint8_t* buffer_begin, const uint8_t* buffer_end, uint8_t* out_buf, uint8_t* out_end, const AdaptiveParams& params) {
+		return decode_adaptive_kernel<S, A, false>(buffer_begin, buffer_end, out_buf, out_end, params);
+	}
+};
+
+template <>
+struct KernelEntries<true> {
+	template <int S, int A, int N>
+	TARGET_BMI2 static int encode(std::span<const uint8_t> sequence, std::span<uint8_t> output, std::span<const typename FixedAccuracyRans<S, A>::EncSymInfo> sym_table) {
+		return encode_ways<S, A, true, N>(sequence, output, sym_table);
+	}
+	template <int S, int A, int N>
+	TARGET_BMI2 static bool decode(const typename FixedAccuracyRans<S, A>::DecSymInfo* dsyms_data, const uint8_t* cum2sym_data, const uint8_t* buffer_begin, const uint8_t* buffer_end, uint8_t* out_buf, uint8_t* out_end) {
+		return decode_ways<S, A, true, N>(dsyms_data, cum2sym_data, buffer_begin, buffer_end, out_buf, out_end);
+	}
+	template <int S, int A, int N>
+	TARGET_BMI2 static bool decode_fused(const typename FixedAccuracyRans<S, A>::DecSlotInfo* slots_data, const uint8_t* buffer_begin, const uint8_t* buffer_end, uint8_t* out_buf, uint8_t* out_end) {
+		return decode_fused_ways<S, A, true, N>(slots_data, buffer_begin, buffer_end, out_buf, out_end);
+	}
+	template <int S, int A, int N>
+	TARGET_BMI2 static bool decode_table(const typename FixedAccuracyRans<S, A>::DecStateInfo* states_data, const uint8_t* buffer_begin, const uint8_t* buffer_end, uint8_t* out_buf, uint8_t* out_end) {
+		return decode_table_ways<S, A, true, N>(states_data, buffer_begin, buffer_end, out_buf, out_end);
+	}
+	template <int S, int A>
+	TARGET_BMI2 static int encode_adaptive(std::span<const uint8_t> sequence, std::span<uint8_t> output, const AdaptiveParams& params) {
+		return encode_adaptive_kernel<S, A, true>(sequence, output, params);
+	}
+	template <int S, int A>
+	TARGET_BMI2 static bool decode_adaptive(const uint8_t* buffer_begin, const uint8_t* buffer_end, uint8_t* out_buf, uint8_t* out_end, const AdaptiveParams& params) {
+		return decode_adaptive_kernel<S, A, true>(buffer_begin, buffer_end, out_buf, out_end, params);
+	}
+};
+
+// indexed by log2 of the number of states: 1, 2, 4, 8
+template <int STATE_BITS, int ACCURACY_BITS>
+struct KernelTable {
+	typedef FixedAccuracyRans<STATE_BITS, ACCURACY_BITS> Rans;
+
+	int (*encode[4])(std::span<const uint8_t>, std::span<uint8_t>, std::span<const typename Rans::EncSymInfo>);
+	bool (*decode[4])(const typename Rans::DecSymInfo*, const uint8_t*, const uint8_t*, const uint8_t*, uint8_t*, uint8_t*);
+	bool (*decode_fused[4])(const typename Rans::DecSlotInfo*, const uint8_t*, const uint8_t*, uint8_t*, uint8_t*);
+	bool (*decode_table[4])(const typename Rans::DecStateInfo*, const uint8_t*, const uint8_t*, uint8_t*, uint8_t*);
+	int (*encode_adaptive)(std::span<const uint8_t>, std::span<uint8_t>, const AdaptiveParams&);
+	bool (*decode_adaptive)(const uint8_t*, const uint8_t*, uint8_t*, uint8_t*, const AdaptiveParams&);
+};
+
+template <int STATE_BITS, int ACCURACY_BITS, bool BMI2>
+static KernelTable<STATE_BITS, ACCURACY_BITS> make_kernel_table() {
+	typedef KernelEntries<BMI2> E;
+	constexpr int S = STATE_BITS, A = ACCURACY_BITS;
+	return {
+		{ E::template encode<S, A, 1>, E::template encode<S, A, 2>, E::template encode<S, A, 4>, E::template encode<S, A, 8> },
+		{ E::template decode<S, A, 1>, E::template decode<S, A, 2>, E::template decode<S, A, 4>, E::template decode<S, A, 8> },
+		{ E::template decode_fused<S, A, 1>, E::template decode_fused<S, A, 2>, E::template decode_fused<S, A, 4>, E::template decode_fused<S, A, 8> },
+		{ E::template decode_table<S, A, 1>, E::template decode_table<S, A, 2>, E::template decode_table<S, A, 4>, E::template decode_table<S, A, 8> },
+		E::template encode_adaptive<S, A>,
+		E::template decode_adaptive<S, A>,
+	};
+}
+
+template <int STATE_BITS, int ACCURACY_BITS>
+static const KernelTable<STATE_BITS, ACCURACY_BITS>& kernels() {
+	static const KernelTable<STATE_BITS, ACCURACY_BITS> table = cpu_level() >= CPU_BMI2
+		? make_kernel_table<STATE_BITS, ACCURACY_BITS, true>()
+		: make_kernel_table<STATE_BITS, ACCURACY_BITS, false>();
+	return table;
+}
+
+template <int N>
+static constexpr int ways_index = std::countr_zero((unsigned)N);
+
+template <int STATE_BITS, int ACCURACY_BITS>
+int FixedAccuracyRans<STATE_BITS, ACCURACY_BITS>::encode(std::span<const uint8_t> sequence, std::span<uint8_t> output, std::span<const EncSymInfo> sym_table) {
+	return kernels<STATE_BITS, ACCURACY_BITS>().encode[0](sequence, output, sym_table);
+}
+
+template <int STATE_BITS, int ACCURACY_BITS>
+bool FixedAccuracyRans<STATE_BITS, ACCURACY_BITS>::decode(const DecSymInfo* dsyms_data, const uint8_t* cum2sym_data,
+	const uint8_t* buffer_begin, const uint8_t* buffer_end, uint8_t* out_buf, uint8_t* out_end
+) {
+	return kernels<STATE_BITS, ACCURACY_BITS>().decode[0](dsyms_data, cum2sym_data, buffer_begin, buffer_end, out_buf, out_end);
+}
+
+template <int STATE_BITS, int ACCURACY_BITS>
+bool FixedAccuracyRans<STATE_BITS, ACCURACY_BITS>::decode_fused(const DecSlotInfo* slots_data,
+	const uint8_t* buffer_begin, const uint8_t* buffer_end, uint8_t* out_buf, uint8_t* out_end
+) {
+	return kernels<STATE_BITS, ACCURACY_BITS>().decode_fused[0](slots_data, buffer_begin, buffer_end, out_buf, out_end);
+}
+
+template <int STATE_BITS, int ACCURACY_BITS>
+bool FixedAccuracyRans<STATE_BITS, ACCURACY_BITS>::decode_table(const DecStateInfo* states_data,
+	const uint8_t* buffer_begin, const uint8_t* buffer_end, uint8_t* out_buf, uint8_t* out_end
+) {
+	return kernels<STATE_BITS, ACCURACY_BITS>().decode_table[0](states_data, buffer_begin, buffer_end, out_buf, out_end);
+}
+
+template <int STATE_BITS, int ACCURACY_BITS>
+int FixedAccuracyRans<STATE_BITS, ACCURACY_BITS>::encode_adaptive(std::span<const uint8_t> sequence, std::span<uint8_t> output, const AdaptiveParams& params) {
+	return kernels<STATE_BITS, ACCURACY_BITS>().encode_adaptive(sequence, output, params);
+}
+
+template <int STATE_BITS, int ACCURACY_BITS>
+bool FixedAccuracyRans<STATE_BITS, ACCURACY_BITS>::decode_adaptive(const uint8_t* buffer_begin, const uint8_t* buffer_end, uint8_t* out_buf, uint8_t* out_end, const AdaptiveParams& params) {
+	return kernels<STATE_BITS, ACCURACY_BITS>().decode_adaptive(buffer_begin, buffer_end, out_buf, out_end, params);
+}
+
+template <int STATE_BITS, int ACCURACY_BITS>
+template <int N>
+int FixedAccuracyRans<STATE_BITS, ACCURACY_BITS>::encode_interleaved(std::span<const uint8_t> sequence, std::span<uint8_t> output, std::span<const EncSymInfo> sym_table) {
+	return kernels<STATE_BITS, ACCURACY_BITS>().encode[ways_index<N>](sequence, output, sym_table);
+}
+
+template <int STATE_BITS, int ACCURACY_BITS>
+template <int N>
+bool FixedAccuracyRans<STATE_BITS, ACCURACY_BITS>::decode_interleaved(const DecSymInfo* dsyms_data, const uint8_t* cum2sym_data,
+	const uint8_t* buffer_begin, const uint8_t* buffer_end, uint8_t* out_buf, uint8_t* out_end
+) {
+	return kernels<STATE_BITS, ACCURACY_BITS>().decode[ways_index<N>](dsyms_data, cum2sym_data, buffer_begin, buffer_end, out_buf, out_end);
+}
+
+template <int STATE_BITS, int ACCURACY_BITS>
+template <int N>
+bool FixedAccuracyRans<STATE_BITS, ACCURACY_BITS>::decode_fused_interleaved(const DecSlotInfo* slots_data,
+	const uint8_t* buffer_begin, const uint8_t* buffer_end, uint8_t* out_buf, uint8_t* out_end
+) {
+	return kernels<STATE_BITS, ACCURACY_BITS>().decode_fused[ways_index<N>](slots_data, buffer_begin, buffer_end, out_buf, out_end);
+}
+
+template <int STATE_BITS, int ACCURACY_BITS>
+template <int N>
+bool FixedAccuracyRans<STATE_BITS, ACCURACY_BITS>::decode_table_interleaved(const DecStateInfo* states_data,
+	const uint8_t* buffer_begin, const uint8_t* buffer_end, uint8_t* out_buf, uint8_t* out_end
+) {
+	return kernels<STATE_BITS, ACCURACY_BITS>().decode_table[ways_index<N>](states_data, buffer_begin, buffer_end, out_buf, out_end);
+}
+
+
+//
+// Explicit instantiations
+//
+
+#define INSTANTIATE_INTERLEAVED(S, A, N) \
+	template int FixedAccuracyRans<S, A>::encode_interleaved<N>(std::span<const uint8_t>, std::span<uint8_t>, std::span<const EncSymInfo>); \
+	template bool FixedAccuracyRans<S, A>::decode_interleaved<N>(const DecSymInfo*, const uint8_t*, const uint8_t*, const uint8_t*, uint8_t*, uint8_t*); \
+	template bool FixedAccuracyRans<S, A>::decode_fused_interleaved<N>(const DecSlotInfo*, const uint8_t*, const uint8_t*, uint8_t*, uint8_t*); \
+	template bool FixedAccuracyRans<S, A>::decode_table_interleaved<N>(const DecStateInfo*, const uint8_t*, const uint8_t*, uint8_t*, uint8_t*);
+
+#define INSTANTIATE(S, A) \
+	template struct FixedAccuracyRans<S, A>; \
+	INSTANTIATE_INTERLEAVED(S, A, 2) \
+	INSTANTIATE_INTERLEAVED(S, A, 4) \
+	INSTANTIATE_INTERLEAVED(S, A, 8)
+
+#define INSTANTIATE_ACCURACIES(S) \
+	INSTANTIATE(S, 1) INSTANTIATE(S, 2) INSTANTIATE(S, 3) INSTANTIATE(S, 4) INSTANTIATE(S, 5) INSTANTIATE(S, 6)
+
+INSTANTIATE_ACCURACIES(10)
+INSTANTIATE_ACCURACIES(11)
+INSTANTIATE_ACCURACIES(12)
+INSTANTIATE_ACCURACIES(13)
+INSTANTIATE_ACCURACIES(14)
+INSTANTIATE_ACCURACIES(15)
+INSTANTIATE_ACCURACIES(16)
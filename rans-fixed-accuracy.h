@@ -1,29 +1,220 @@
 #pragma once
 
 #include <vector>
+#include <span>
+#include <type_traits>
 #include <stdint.h>
 
 #include "sym-stats.h"
 
-struct EncSymInfo {
-	uint32_t delta;
-	uint16_t cumm_freq;
-	uint16_t freq;
+//
+// rANS with fixed accuracy: the state is kept in STATE_BITS + ACCURACY_BITS + 1 bits and the division
+// by the symbol frequency is replaced by ACCURACY_BITS steps of the binary long division.
+// Explicitly instantiated for STATE_BITS = 10..16 and ACCURACY_BITS = 1..6.
+//
+
+// the model updates of the adaptive coders, the decoder needs the parameters of the encoder
+struct AdaptiveParams {
+	uint32_t period = 1024;			// symbols between the model updates after the warmup
+	uint32_t first_period = 64;		// the first update comes after first_period symbols, the period doubles up to period
+	int decay_shift = 1;			// an update keeps count - (count >> decay_shift) of the old counts, clamped to 0..16
 };
 
-struct DecSymInfo {
-	uint32_t cumm_freq;
-	uint32_t freq;
+template <int STATE_BITS, int ACCURACY_BITS>
+struct FixedAccuracyRans {
+	static constexpr int ALL_BITS = STATE_BITS + ACCURACY_BITS;
+	static constexpr int ACCURACY_MASK = (1 << (ACCURACY_BITS + 1)) - 1;
+	static constexpr int STATE_MASK = (1 << STATE_BITS) - 1;
+
+	static_assert(STATE_BITS * 3 + ACCURACY_BITS + 8 <= 64, "Ensure three iterations of encode_symbol without flush_bits");
+	static_assert(ALL_BITS < 32 - 7, "");
+	static_assert(ACCURACY_BITS >= 1, "");
+
+	// a single symbol gets the frequency 1 << STATE_BITS which does not fit 16 bits for STATE_BITS = 16
+	typedef std::conditional_t<(STATE_BITS < 16), uint16_t, uint32_t> freq_t;
+
+	struct EncSymInfo {
+		uint32_t delta;
+		freq_t cumm_freq;
+		freq_t freq;
+	};
+
+	struct DecSymInfo {
+		uint32_t cumm_freq;
+		uint32_t freq;
+	};
+
+	typedef struct {
+		std::vector<EncSymInfo> esyms;
+		std::vector<DecSymInfo> dsyms;
+		std::vector<uint8_t> cum2sym;
+	} SequenceInfo;
+
+	// fused decoding table entry indexed by the slot: z = freq * (x >> STATE_BITS) + bias has either bits or bits + 1 bits
+	struct DecSlotInfo {
+		freq_t freq;
+		freq_t bias;	// slot - cumm_freq
+		uint8_t sym;
+		uint8_t bits;
+	};
+
+	// table decoding entry indexed by the normalized state x - (1 << ALL_BITS): the symbol in the bits 0..7,
+	// the number of bits to read in the bits 8..12 and the next normalized state without these bits above
+	typedef std::conditional_t<(ALL_BITS <= 19), uint32_t, uint64_t> DecStateInfo;
+
+	// the statistics come from count_freqs_sampled when sample is set
+	static SequenceInfo init(std::span<const uint8_t> sequence, const SampleParams* sample = nullptr);
+	// the tables for stats normalized to 1 << STATE_BITS
+	static SequenceInfo init(const SymbolStats& stats);
+	// the largest output of encode (ways = 1) or encode_interleaved<ways> for n symbols: at most STATE_BITS bits
+	// per symbol, ALL_BITS + 1 bits for every extra state and 4 bytes for the last one; nothing is written past it
+	static size_t max_encoded_size(size_t n, int ways = 1);
+	static int encode(std::span<const uint8_t> sequence, std::span<uint8_t> buf, std::span<const EncSymInfo> esyms);
+	// the decoders read nothing outside buffer_begin..buffer_end and return false when the stream runs out before out_end
+	// or is not used up exactly there; the output is then garbage
+	static bool decode(const DecSymInfo* dsyms_data, const uint8_t* cum2sym_data, const uint8_t* buffer_begin, const uint8_t* buffer_end, uint8_t* out_buf, uint8_t* out_end);
+
+	// decoding with one lookup per symbol in the table built by init_dec_slots (the streams are the same)
+	static std::vector<DecSlotInfo> init_dec_slots(std::span<const DecSymInfo> dsyms, std::span<const uint8_t> cum2sym);
+	static bool decode_fused(const DecSlotInfo* slots_data, const uint8_t* buffer_begin, const uint8_t* buffer_end, uint8_t* out_buf, uint8_t* out_end);
+
+	// decoding with neither multiplications nor bit_width in the table built by init_dec_states (the streams are the same),
+	// the table has 1 << ALL_BITS entries so smaller STATE_BITS keep it in L2
+	static std::vector<DecStateInfo> init_dec_states(std::span<const DecSymInfo> dsyms, std::span<const uint8_t> cum2sym);
+	static bool decode_table(const DecStateInfo* states_data, const uint8_t* buffer_begin, const uint8_t* buffer_end, uint8_t* out_buf, uint8_t* out_end);
+
+	// one-pass adaptive coding without stored statistics: the model starts uniform and is rebuilt after every chunk
+	// of symbols from the decayed counts of the symbols coded so far, with at least one slot per symbol. The decoder
+	// repeats the updates and finds the symbols through 256 slot buckets, so cum2sym is never rebuilt.
+	// The output is bounded by max_encoded_size(n)
+	static int encode_adaptive(std::span<const uint8_t> sequence, std::span<uint8_t> buf, const AdaptiveParams& params = {});
+	static bool decode_adaptive(const uint8_t* buffer_begin, const uint8_t* buffer_end, uint8_t* out_buf, uint8_t* out_end, const AdaptiveParams& params = {});
+
+	// N-way interleaved variants (N = 2, 4, 8); the streams are not compatible with the single-state ones
+	template <int N>
+	static int encode_interleaved(std::span<const uint8_t> sequence, std::span<uint8_t> buf, std::span<const EncSymInfo> esyms);
+	template <int N>
+	static bool decode_interleaved(const DecSymInfo* dsyms_data, const uint8_t* cum2sym_data, const uint8_t* buffer_begin, const uint8_t* buffer_end, uint8_t* out_buf, uint8_t* out_end);
+	template <int N>
+	static bool decode_fused_interleaved(const DecSlotInfo* slots_data, const uint8_t* buffer_begin, const uint8_t* buffer_end, uint8_t* out_buf, uint8_t* out_end);
+	template <int N>
+	static bool decode_table_interleaved(const DecStateInfo* states_data, const uint8_t* buffer_begin, const uint8_t* buffer_end, uint8_t* out_buf, uint8_t* out_end);
+
+	// the tables of init and init_dec_slots in fixed storage that is rebuilt in place, so coding a message does not allocate
+	struct Context {
+		alignas(64) EncSymInfo esyms[256];
+		alignas(64) DecSymInfo dsyms[256];
+		alignas(64) uint8_t cum2sym[1 << STATE_BITS];
+		alignas(64) DecSlotInfo slots[1 << STATE_BITS];
+
+		void init(std::span<const uint8_t> sequence, const SampleParams* sample = nullptr);
+		void init(const SymbolStats& stats);
+		// the fused decoding table for the current esyms, dsyms and cum2sym
+		void init_dec_slots();
+	};
 };
 
-typedef struct {
-	std::vector<EncSymInfo> esyms;
-	std::vector<DecSymInfo> dsyms;
-	std::vector<uint8_t> cum2sym;
-} SequenceInfo;
 
+//
+// The two configurations from the paper
+//
+
+typedef FixedAccuracyRans<14, 3> RansWithAccuracy3;
+typedef FixedAccuracyRans<14, 2> RansWithAccuracy2;
+
+typedef RansWithAccuracy3::EncSymInfo EncSymInfo;
+typedef RansWithAccuracy3::DecSymInfo DecSymInfo;
+typedef RansWithAccuracy3::SequenceInfo SequenceInfo;
+typedef RansWithAccuracy3::DecSlotInfo DecSlotInfo;
+typedef RansWithAccuracy3::DecStateInfo DecStateInfo;
+typedef RansWithAccuracy3::Context RansContext;
+typedef RansWithAccuracy2::EncSymInfo EncSymInfo_2;
+typedef RansWithAccuracy2::DecSymInfo DecSymInfo_2;
+typedef RansWithAccuracy2::SequenceInfo SequenceInfo_2;
+typedef RansWithAccuracy2::DecSlotInfo DecSlotInfo_2;
+typedef RansWithAccuracy2::DecStateInfo DecStateInfo_2;
+typedef RansWithAccuracy2::Context RansContext_2;
+
+inline SequenceInfo init_rANS_with_accuracy_3(std::span<const uint8_t> sequence, const SampleParams* sample = nullptr) {
+	return RansWithAccuracy3::init(sequence, sample);
+}
+
+inline SequenceInfo init_rANS_with_accuracy_3(const SymbolStats& stats) {
+	return RansWithAccuracy3::init(stats);
+}
+
+inline int encode_rANS_with_accuracy_3(std::span<const uint8_t> sequence, std::span<uint8_t> buf, std::span<const EncSymInfo> esyms) {
+	return RansWithAccuracy3::encode(sequence, buf, esyms);
+}
+
+inline bool decode_rANS(const DecSymInfo* dsyms_data, const uint8_t* cum2sym_data, const uint8_t* buffer_begin, const uint8_t* buffer_end, uint8_t* out_buf, uint8_t* out_end) {
+	return RansWithAccuracy3::decode(dsyms_data, cum2sym_data, buffer_begin, buffer_end, out_buf, out_end);
+}
+
+inline bool decode_rANS_fused(const DecSlotInfo* slots_data, const uint8_t* buffer_begin, const uint8_t* buffer_end, uint8_t* out_buf, uint8_t* out_end) {
+	return RansWithAccuracy3::decode_fused(slots_data, buffer_begin, buffer_end, out_buf, out_end);
+}
+
+inline bool decode_rANS_table(const DecStateInfo* states_data, const uint8_t* buffer_begin, const uint8_t* buffer_end, uint8_t* out_buf, uint8_t* out_end) {
+	return RansWithAccuracy3::decode_table(states_data, buffer_begin, buffer_end, out_buf, out_end);
+}
+
+inline int encode_rANS_with_accuracy_3_adaptive(std::span<const uint8_t> sequence, std::span<uint8_t> buf, const AdaptiveParams& params = {}) {
+	return RansWithAccuracy3::encode_adaptive(sequence, buf, params);
+}
+
+inline bool decode_rANS_adaptive(const uint8_t* buffer_begin, const uint8_t* buffer_end, uint8_t* out_buf, uint8_t* out_end, const AdaptiveParams& params = {}) {
+	return RansWithAccuracy3::decode_adaptive(buffer_begin, buffer_end, out_buf, out_end, params);
+}
+
+template <int N>
+inline int encode_rANS_with_accuracy_3_interleaved(std::span<const uint8_t> sequence, std::span<uint8_t> buf, std::span<const EncSymInfo> esyms) {
+	return RansWithAccuracy3::encode_interleaved<N>(sequence, buf, esyms);
+}
+
+template <int N>
+inline bool decode_rANS_interleaved(const DecSymInfo* dsyms_data, const uint8_t* cum2sym_data, const uint8_t* buffer_begin, const uint8_t* buffer_end, uint8_t* out_buf, uint8_t* out_end) {
+	return RansWithAccuracy3::decode_interleaved<N>(dsyms_data, cum2sym_data, buffer_begin, buffer_end, out_buf, out_end);
+}
+
+inline SequenceInfo_2 init_rANS_with_accuracy_2(std::span<const uint8_t> sequence, const SampleParams* sample = nullptr) {
+	return RansWithAccuracy2::init(sequence, sample);
+}
+
+inline SequenceInfo_2 init_rANS_with_accuracy_2(const SymbolStats& stats) {
+	return RansWithAccuracy2::init(stats);
+}
+
+inline int encode_rANS_with_accuracy_2(std::span<const uint8_t> sequence, std::span<uint8_t> buf, std::span<const EncSymInfo_2> esyms) {
+	return RansWithAccuracy2::encode(sequence, buf, esyms);
+}
+
+inline bool decode_rANS_2(const DecSymInfo_2* dsyms_data, const uint8_t* cum2sym_data, const uint8_t* buffer_begin, const uint8_t* buffer_end, uint8_t* out_buf, uint8_t* out_end) {
+	return RansWithAccuracy2::decode(dsyms_data, cum2sym_data, buffer_begin, buffer_end, out_buf, out_end);
+}
+
+inline bool decode_rANS_2_fused(const DecSlotInfo_2* slots_data, const uint8_t* buffer_begin, const uint8_t* buffer_end, uint8_t* out_buf, uint8_t* out_end) {
+	return RansWithAccuracy2::decode_fused(slots_data, buffer_begin, buffer_end, out_buf, out_end);
+}
+
+inline bool decode_rANS_2_table(const DecStateInfo_2* states_data, const uint8_t* buffer_begin, const uint8_t* buffer_end, uint8_t* out_buf, uint8_t* out_end) {
+	return RansWithAccuracy2::decode_table(states_data, buffer_begin, buffer_end, out_buf, out_end);
+}
+
+inline int encode_rANS_with_accuracy_2_adaptive(std::span<const uint8_t> sequence, std::span<uint8_t> buf, const AdaptiveParams& params = {}) {
+	return RansWithAccuracy2::encode_adaptive(sequence, buf, params);
+}
+
+inline bool decode_rANS_2_adaptive(const uint8_t* buffer_begin, const uint8_t* buffer_end, uint8_t* out_buf, uint8_t* out_end, const AdaptiveParams& params = {}) {
+	return RansWithAccuracy2::decode_adaptive(buffer_begin, buffer_end, out_buf, out_end, params);
+}
 
-SequenceInfo init_rANS_with_accuracy_3(const std::vector<uint8_t>& sequence);
-int encode_rANS_with_accuracy_3(const std::vector<uint8_t>& sequence, std::vector<uint8_t>& buf, const std::vector<EncSymInfo>& esyms);
-void decode_rANS(const DecSymInfo* dsyms_data, const uint8_t* cum2sym_data, const uint8_t* buffer_end, uint8_t* out_buf, uint8_t* out_end);
+template <int N>
+inline int encode_rANS_with_accuracy_2_interleaved(std::span<const uint8_t> sequence, std::span<uint8_t> buf, std::span<const EncSymInfo_2> esyms) {
+	return RansWithAccuracy2::encode_interleaved<N>(sequence, buf, esyms);
+}
 
+template <int N>
+inline bool decode_rANS_2_interleaved(const DecSymInfo_2* dsyms_data, const uint8_t* cum2sym_data, const uint8_t* buffer_begin, const uint8_t* buffer_end, uint8_t* out_buf, uint8_t* out_end) {
+	return RansWithAccuracy2::decode_interleaved<N>(dsyms_data, cum2sym_data, buffer_begin, buffer_end, out_buf, out_end);
+}
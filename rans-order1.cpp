@@ -0,0 +1,232 @@
+#include <vector>
+#include <bit>
+#include <stdint.h>
+#include <string.h>
+
+#include "sym-stats.h"
+#include "rans-order1.h"
+#include "rans-fixed-accuracy-kernels.h"
+#include "stream-header.h"
+#include "cpu-features.h"
+
+
+//
+// Model
+//
+
+template <int STATE_BITS, int ACCURACY_BITS>
+static void build_context(const SymbolStats& stats, typename Order1Rans<STATE_BITS, ACCURACY_BITS>::EncSymInfo* esyms,
+	typename Order1Rans<STATE_BITS, ACCURACY_BITS>::DecSymInfo* dsyms, uint8_t* cum2sym
+) {
+	for (int s = 0; s < 256; s++) {
+		memset(cum2sym + stats.cum_freqs[s], s, stats.freqs[s]);
+		dsyms[s].cumm_freq = stats.cum_freqs[s];
+		dsyms[s].freq = stats.freqs[s];
+		init_enc_symbol<STATE_BITS, ACCURACY_BITS>(esyms[s], stats.cum_freqs[s], stats.freqs[s]);
+	}
+}
+
+template <int STATE_BITS, int ACCURACY_BITS>
+static void resize_tables(typename Order1Rans<STATE_BITS, ACCURACY_BITS>::Model& model) {
+	model.esyms.resize((size_t)model.contexts * 256);
+	model.dsyms.resize((size_t)model.contexts * 256);
+	model.cum2sym.resize((size_t)model.contexts << STATE_BITS);
+}
+
+template <int STATE_BITS, int ACCURACY_BITS>
+void Order1Rans<STATE_BITS, ACCURACY_BITS>::init(std::span<const uint8_t> sequence, Model& model) {
+	std::vector<uint32_t> counts(256 * 256);
+	uint8_t ctx = 0;
+	for (uint8_t sym : sequence) {
+		counts[ctx << 8 | sym]++;
+		ctx = sym;
+	}
+
+	model.contexts = 0;
+	for (int c = 0; c < 256; c++) {
+		bool present = false;
+		for (int s = 0; s < 256 && !present; s++)
+			present = counts[c << 8 | s] != 0;
+		model.index[c] = present ? model.contexts++ : NO_CONTEXT;
+	}
+	resize_tables<STATE_BITS, ACCURACY_BITS>(model);
+
+	SymbolStats stats;
+	for (int c = 0; c < 256; c++) {
+		size_t table = model.index[c];
+		if (table == NO_CONTEXT)
+			continue;
+		memcpy(stats.freqs, &counts[c << 8], sizeof(stats.freqs));
+		stats.normalize_freqs(1 << STATE_BITS);
+		build_context<STATE_BITS, ACCURACY_BITS>(stats, &model.esyms[table << 8], &model.dsyms[table << 8], &model.cum2sym[table << STATE_BITS]);
+	}
+}
+
+template <int STATE_BITS, int ACCURACY_BITS>
+size_t Order1Rans<STATE_BITS, ACCURACY_BITS>::max_model_size(const Model& model) {
+	return 32 + (size_t)model.contexts * MAX_FREQ_TABLE_SIZE;
+}
+
+template <int STATE_BITS, int ACCURACY_BITS>
+size_t Order1Rans<STATE_BITS, ACCURACY_BITS>::write_model(const Model& model, uint8_t* out) {
+	uint8_t* ptr = out;
+	memset(ptr, 0, 32);
+	for (int c = 0; c < 256; c++) {
+		if (model.index[c] != NO_CONTEXT)
+			ptr[c >> 3] |= 1 << (c & 7);
+	}
+	ptr += 32;
+
+	uint32_t freqs[256];
+	for (int c = 0; c < 256; c++) {
+		size_t table = model.index[c];
+		if (table == NO_CONTEXT)
+			continue;
+		for (int s = 0; s < 256; s++)
+			freqs[s] = model.dsyms[table << 8 | s].freq;
+		ptr = write_freq_table(freqs, ptr);
+	}
+	return ptr - out;
+}
+
+template <int STATE_BITS, int ACCURACY_BITS>
+size_t Order1Rans<STATE_BITS, ACCURACY_BITS>::read_model(const uint8_t* in, size_t size, Model& model) {
+	if (size < 32)
+		return 0;
+	model.contexts = 0;
+	for (int c = 0; c < 256; c++)
+		model.index[c] = (in[c >> 3] >> (c & 7)) & 1 ? model.contexts++ : NO_CONTEXT;
+	resize_tables<STATE_BITS, ACCURACY_BITS>(model);
+
+	const uint8_t* ptr = in + 32;
+	const uint8_t* end = in + size;
+	SymbolStats stats;
+	for (int c = 0; c < 256; c++) {
+		size_t table = model.index[c];
+		if (table == NO_CONTEXT)
+			continue;
+		if (!(ptr = read_freq_table(ptr, end, 1 << STATE_BITS, stats)))
+			return 0;
+		build_context<STATE_BITS, ACCURACY_BITS>(stats, &model.esyms[table << 8], &model.dsyms[table << 8], &model.cum2sym[table << STATE_BITS]);
+	}
+	return ptr - in;
+}
+
+
+//
+// Coding
+//
+
+template <int STATE_BITS, int ACCURACY_BITS, bool BMI2>
+static FORCE_INLINE int encode_kernel(std::span<const uint8_t> sequence, std::span<uint8_t> output,
+	const typename Order1Rans<STATE_BITS, ACCURACY_BITS>::Model& model
+) {
+	constexpr int ALL_BITS = STATE_BITS + ACCURACY_BITS;
+	uint32_t x = 1 << ALL_BITS;
+	uint64_t output_word = 0;
+	uint8_t ptr = 0;		// bit pointer inside the output_word
+	const uint8_t* sequence_data = sequence.data();
+	uint8_t* buffer = output.data();
+	const uint8_t* buffer_end = output.data() + output.size();
+	const typename Order1Rans<STATE_BITS, ACCURACY_BITS>::EncSymInfo* esyms = model.esyms.data();
+
+	// the symbol i is coded in the context of the symbol i - 1
+	auto encode_at = [&](size_t i) {
+		size_t table = model.index[i ? sequence_data[i - 1] : 0];
+		return encode_symbol<STATE_BITS, ACCURACY_BITS, BMI2>(esyms[table << 8 | sequence_data[i]], x, output_word, ptr);
+	};
+
+	size_t i = sequence.size();
+	while (i >= 3) {
+		x = encode_at(--i);
+		x = encode_at(--i);
+		x = encode_at(--i);
+		flush_bits(output_word, ptr, buffer, buffer_end);
+	}
+	while (i > 0) {
+		x = encode_at(--i);
+		flush_bits(output_word, ptr, buffer, buffer_end);
+	}
+
+	finish_stream(x, output_word, ptr, buffer);
+	return buffer - output.data();
+}
+
+template <int STATE_BITS, int ACCURACY_BITS, bool BMI2>
+static FORCE_INLINE bool decode_kernel(const typename Order1Rans<STATE_BITS, ACCURACY_BITS>::Model& model,
+	const uint8_t* buffer_begin, const uint8_t* buffer_end, uint8_t* out_buf, uint8_t* out_end
+) {
+	typedef Order1Rans<STATE_BITS, ACCURACY_BITS> Order1;
+	InputBuffer in = { buffer_begin, buffer_end, 0 };
+	uint32_t x;
+	uint64_t input_word;
+	uint8_t ptr;
+	if (!read_states<STATE_BITS, Order1::Rans::ALL_BITS, 1, BMI2>(&x, input_word, ptr, in))
+		return false;
+
+	uint8_t ctx = 0;
+	while (out_buf != out_end) {
+		size_t table = model.index[ctx];
+		if (table == Order1::NO_CONTEXT)
+			return false;
+		const typename Order1::DecSymInfo* dsyms = model.dsyms.data() + (table << 8);
+		uint32_t y = x & Order1::Rans::STATE_MASK;
+		uint8_t sym = model.cum2sym[table << STATE_BITS | y];
+		*out_buf++ = sym;
+		x = decode_step<STATE_BITS, ACCURACY_BITS, BMI2>(dsyms[sym].freq, y - dsyms[sym].cumm_freq, x, input_word, ptr, in);
+		ctx = sym;
+	}
+	return stream_used_up<1>(&x, 1 << Order1::Rans::ALL_BITS, ptr, in);
+}
+
+// the kernels compiled for the baseline and for BMI2, selected on the first call as in rans-fixed-accuracy.cpp
+template <int STATE_BITS, int ACCURACY_BITS>
+static int encode_baseline(std::span<const uint8_t> sequence, std::span<uint8_t> output, const typename Order1Rans<STATE_BITS, ACCURACY_BITS>::Model& model) {
+	return encode_kernel<STATE_BITS, ACCURACY_BITS, false>(sequence, output, model);
+}
+
+template <int STATE_BITS, int ACCURACY_BITS>
+TARGET_BMI2 static int encode_bmi2(std::span<const uint8_t> sequence, std::span<uint8_t> output, const typename Order1Rans<STATE_BITS, ACCURACY_BITS>::Model& model) {
+	return encode_kernel<STATE_BITS, ACCURACY_BITS, true>(sequence, output, model);
+}
+
+template <int STATE_BITS, int ACCURACY_BITS>
+static bool decode_baseline(const typename Order1Rans<STATE_BITS, ACCURACY_BITS>::Model& model, const uint8_t* buffer_begin, const uint8_t* buffer_end, uint8_t* out_buf, uint8_t* out_end) {
+	return decode_kernel<STATE_BITS, ACCURACY_BITS, false>(model, buffer_begin, buffer_end, out_buf, out_end);
+}
+
+template <int STATE_BITS, int ACCURACY_BITS>
+TARGET_BMI2 static bool decode_bmi2(const typename Order1Rans<STATE_BITS, ACCURACY_BITS>::Model& model, const uint8_t* buffer_begin, const uint8_t* buffer_end, uint8_t* out_buf, uint8_t* out_end) {
+	return decode_kernel<STATE_BITS, ACCURACY_BITS, true>(model, buffer_begin, buffer_end, out_buf, out_end);
+}
+
+template <int STATE_BITS, int ACCURACY_BITS>
+int Order1Rans<STATE_BITS, ACCURACY_BITS>::encode(std::span<const uint8_t> sequence, std::span<uint8_t> output, const Model& model) {
+	typedef int (*EncodeKernel)(std::span<const uint8_t>, std::span<uint8_t>, const Model&);
+	static const EncodeKernel kernel = cpu_level() >= CPU_BMI2 ? encode_bmi2<STATE_BITS, ACCURACY_BITS> : encode_baseline<STATE_BITS, ACCURACY_BITS>;
+	return kernel(sequence, output, model);
+}
+
+template <int STATE_BITS, int ACCURACY_BITS>
+bool Order1Rans<STATE_BITS, ACCURACY_BITS>::decode(const Model& model, const uint8_t* buffer_begin, const uint8_t* buffer_end, uint8_t* out_buf, uint8_t* out_end) {
+	typedef bool (*DecodeKernel)(const Model&, const uint8_t*, const uint8_t*, uint8_t*, uint8_t*);
+	static const DecodeKernel kernel = cpu_level() >= CPU_BMI2 ? decode_bmi2<STATE_BITS, ACCURACY_BITS> : decode_baseline<STATE_BITS, ACCURACY_BITS>;
+	return kernel(model, buffer_begin, buffer_end, out_buf, out_end);
+}
+
+
+//
+// Explicit instantiations
+//
+
+#define INSTANTIATE_ACCURACIES(S) \
+	template struct Order1Rans<S, 1>; template struct Order1Rans<S, 2>; template struct Order1Rans<S, 3>; \
+	template struct Order1Rans<S, 4>; template struct Order1Rans<S, 5>; template struct Order1Rans<S, 6>;
+
+INSTANTIATE_ACCURACIES(10)
+INSTANTIATE_ACCURACIES(11)
+INSTANTIATE_ACCURACIES(12)
+INSTANTIATE_ACCURACIES(13)
+INSTANTIATE_ACCURACIES(14)
+INSTANTIATE_ACCURACIES(15)
+INSTANTIATE_ACCURACIES(16)
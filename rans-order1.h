@@ -0,0 +1,60 @@
+#pragma once
+
+#include <vector>
+#include <span>
+#include <stdint.h>
+
+#include "rans-fixed-accuracy.h"
+
+//
+// Order-1 context modeling on the fixed-accuracy coders: the previous byte selects the model of the next one and
+// the first byte is coded in the context 0. Only the contexts that occur get tables, packed one after another in
+// the context order. The model is serialized as a 32-byte bitmap of these contexts followed by their frequency
+// tables in the stream header format (write_freq_table).
+// Explicitly instantiated for STATE_BITS = 10..16 and ACCURACY_BITS = 1..6.
+//
+
+template <int STATE_BITS, int ACCURACY_BITS>
+struct Order1Rans {
+	typedef FixedAccuracyRans<STATE_BITS, ACCURACY_BITS> Rans;
+	typedef typename Rans::freq_t freq_t;
+	typedef typename Rans::EncSymInfo EncSymInfo;
+
+	static constexpr uint16_t NO_CONTEXT = 0xFFFF;
+
+	// Rans::DecSymInfo in half the size
+	struct DecSymInfo {
+		freq_t cumm_freq;
+		freq_t freq;
+	};
+
+	struct Model {
+		uint16_t index[256];			// the table number of every context, NO_CONTEXT if it never occurs
+		int contexts = 0;
+		std::vector<EncSymInfo> esyms;	// 256 per present context
+		std::vector<DecSymInfo> dsyms;	// 256 per present context
+		std::vector<uint8_t> cum2sym;	// 1 << STATE_BITS per present context
+
+		// the memory taken by the tables of the present contexts
+		size_t table_bytes() const {
+			return (size_t)contexts * (256 * (sizeof(EncSymInfo) + sizeof(DecSymInfo)) + (1 << STATE_BITS));
+		}
+	};
+
+	// the statistics of every context normalized to 1 << STATE_BITS
+	static void init(std::span<const uint8_t> sequence, Model& model);
+	// the largest output of write_model
+	static size_t max_model_size(const Model& model);
+	static size_t write_model(const Model& model, uint8_t* out);
+	// rebuilds the tables from the output of write_model, returns its size or 0 if it is malformed or truncated
+	static size_t read_model(const uint8_t* in, size_t size, Model& model);
+
+	static size_t max_encoded_size(size_t n) { return Rans::max_encoded_size(n); }
+	static int encode(std::span<const uint8_t> sequence, std::span<uint8_t> buf, const Model& model);
+	// false if the stream from buffer_begin to buffer_end runs out, is not used up at out_end or reaches a context
+	// absent from the model; nothing outside the stream is read
+	static bool decode(const Model& model, const uint8_t* buffer_begin, const uint8_t* buffer_end, uint8_t* out_buf, uint8_t* out_end);
+};
+
+typedef Order1Rans<14, 3> Order1RansWithAccuracy3;
+typedef Order1Rans<14, 2> Order1RansWithAccuracy2;
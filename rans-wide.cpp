@@ -0,0 +1,218 @@
+#include <algorithm>
+#include <memory>
+#include <vector>
+#include <stdint.h>
+#include <string.h>
+
+#include "sym-stats.h"
+#include "rans-wide.h"
+#include "rans-fixed-accuracy-kernels.h"
+#include "stream-header.h"
+#include "cpu-features.h"
+
+
+//
+// Model
+//
+
+template <int ALPHABET_BITS, int STATE_BITS, int ACCURACY_BITS>
+bool WideRans<ALPHABET_BITS, STATE_BITS, ACCURACY_BITS>::init(std::span<const symbol_t> sequence, Tables& tables) {
+	auto stats = std::make_unique<Stats>();		// 512 KB for 16-bit symbols
+	stats->count_freqs(sequence.data(), sequence.size());
+	if (!stats->normalize_freqs(1 << STATE_BITS))
+		return false;
+	init(*stats, tables);
+	return true;
+}
+
+template <int ALPHABET_BITS, int STATE_BITS, int ACCURACY_BITS>
+void WideRans<ALPHABET_BITS, STATE_BITS, ACCURACY_BITS>::init(const Stats& stats, Tables& tables) {
+	tables.rank.assign(ALPHABET_SIZE, 0);
+	tables.esyms.clear();
+	tables.dsyms.clear();
+	tables.cum2sym.assign(1 << STATE_BITS, 0);
+	for (int s = 0; s < ALPHABET_SIZE; s++) {
+		uint32_t freq = stats.freqs[s];
+		if (!freq)
+			continue;
+		uint16_t rank = (uint16_t)tables.esyms.size();
+		uint32_t cumm_freq = stats.cum_freqs[s];
+		tables.rank[s] = rank;
+		init_enc_symbol<STATE_BITS, ACCURACY_BITS>(tables.esyms.emplace_back(), cumm_freq, freq);
+		tables.dsyms.push_back({ (freq_t)cumm_freq, (freq_t)freq, (symbol_t)s });
+		std::fill_n(tables.cum2sym.begin() + cumm_freq, freq, rank);
+	}
+}
+
+template <int ALPHABET_BITS, int STATE_BITS, int ACCURACY_BITS>
+size_t WideRans<ALPHABET_BITS, STATE_BITS, ACCURACY_BITS>::write_model(const Tables& tables, uint8_t* out) {
+	uint8_t* ptr = put_varint(out, tables.symbols());
+	int prev = -1;
+	for (size_t i = 0; i < tables.symbols(); i++) {
+		const DecSymInfo& dsym = tables.dsyms[i];
+		uint32_t gap = dsym.sym - prev - 1;
+		uint64_t code = (uint64_t)(i + 1 == tables.symbols() ? 0 : dsym.freq - 1) << 1 | (gap != 0);
+		ptr = put_varint(ptr, code);
+		if (gap)
+			ptr = put_varint(ptr, gap - 1);
+		prev = dsym.sym;
+	}
+	return ptr - out;
+}
+
+template <int ALPHABET_BITS, int STATE_BITS, int ACCURACY_BITS>
+size_t WideRans<ALPHABET_BITS, STATE_BITS, ACCURACY_BITS>::read_model(const uint8_t* in, size_t size, Tables& tables) {
+	constexpr uint32_t total = 1 << STATE_BITS;
+	const uint8_t* ptr = in;
+	const uint8_t* end = in + size;
+	uint64_t count;
+	if (!(ptr = get_varint(ptr, end, count)) || count > std::min<uint32_t>(ALPHABET_SIZE, total))
+		return 0;
+
+	auto stats = std::make_unique<Stats>();
+	memset(stats->freqs, 0, sizeof(stats->freqs));
+	uint32_t sum = 0;
+	int s = -1;
+	for (uint64_t i = 0; i < count; i++) {
+		uint64_t code, gap = 0;
+		if (!(ptr = get_varint(ptr, end, code)))
+			return 0;
+		if ((code & 1) && !(ptr = get_varint(ptr, end, gap)))
+			return 0;
+		s += 1 + (int)(code & 1) + (int)std::min<uint64_t>(gap, ALPHABET_SIZE);
+		if (s >= ALPHABET_SIZE)
+			return 0;
+		uint64_t freq = i + 1 == count ? (uint64_t)total - sum : (code >> 1) + 1;
+		if (freq == 0 || freq > total - sum)
+			return 0;
+		stats->freqs[s] = (uint32_t)freq;
+		sum += (uint32_t)freq;
+	}
+
+	stats->calc_cum_freqs();
+	init(*stats, tables);
+	return ptr - in;
+}
+
+
+//
+// Coding
+//
+
+template <int ALPHABET_BITS, int STATE_BITS, int ACCURACY_BITS, bool BMI2>
+static FORCE_INLINE int encode_kernel(std::span<const typename WideRans<ALPHABET_BITS, STATE_BITS, ACCURACY_BITS>::symbol_t> sequence,
+	std::span<uint8_t> output, const typename WideRans<ALPHABET_BITS, STATE_BITS, ACCURACY_BITS>::Tables& tables
+) {
+	constexpr int ALL_BITS = STATE_BITS + ACCURACY_BITS;
+	uint32_t x = 1 << ALL_BITS;
+	uint64_t output_word = 0;
+	uint8_t ptr = 0;		// bit pointer inside the output_word
+	uint8_t* buffer = output.data();
+	const uint8_t* buffer_end = output.data() + output.size();
+	const uint16_t* rank = tables.rank.data();
+	const typename WideRans<ALPHABET_BITS, STATE_BITS, ACCURACY_BITS>::EncSymInfo* esyms = tables.esyms.data();
+
+	auto encode_at = [&](size_t i) {
+		return encode_symbol<STATE_BITS, ACCURACY_BITS, BMI2>(esyms[rank[sequence[i]]], x, output_word, ptr);
+	};
+
+	size_t i = sequence.size();
+	while (i >= 3) {
+		x = encode_at(--i);
+		x = encode_at(--i);
+		x = encode_at(--i);
+		flush_bits(output_word, ptr, buffer, buffer_end);
+	}
+	while (i > 0) {
+		x = encode_at(--i);
+		flush_bits(output_word, ptr, buffer, buffer_end);
+	}
+
+	finish_stream(x, output_word, ptr, buffer);
+	return buffer - output.data();
+}
+
+template <int ALPHABET_BITS, int STATE_BITS, int ACCURACY_BITS, bool BMI2>
+static FORCE_INLINE bool decode_kernel(const typename WideRans<ALPHABET_BITS, STATE_BITS, ACCURACY_BITS>::Tables& tables,
+	const uint8_t* buffer_begin, const uint8_t* buffer_end, typename WideRans<ALPHABET_BITS, STATE_BITS, ACCURACY_BITS>::symbol_t* out_buf,
+	typename WideRans<ALPHABET_BITS, STATE_BITS, ACCURACY_BITS>::symbol_t* out_end
+) {
+	typedef WideRans<ALPHABET_BITS, STATE_BITS, ACCURACY_BITS> Wide;
+	InputBuffer in = { buffer_begin, buffer_end, 0 };
+	uint32_t x;
+	uint64_t input_word;
+	uint8_t ptr;
+	if (!read_states<STATE_BITS, Wide::Rans::ALL_BITS, 1, BMI2>(&x, input_word, ptr, in))
+		return false;
+
+	const typename Wide::DecSymInfo* dsyms = tables.dsyms.data();
+	const uint16_t* cum2sym = tables.cum2sym.data();
+	while (out_buf != out_end) {
+		uint32_t y = x & Wide::Rans::STATE_MASK;
+		const typename Wide::DecSymInfo& dsym = dsyms[cum2sym[y]];
+		*out_buf++ = dsym.sym;
+		x = decode_step<STATE_BITS, ACCURACY_BITS, BMI2>(dsym.freq, y - dsym.cumm_freq, x, input_word, ptr, in);
+	}
+	return stream_used_up<1>(&x, 1 << Wide::Rans::ALL_BITS, ptr, in);
+}
+
+// the kernels compiled for the baseline and for BMI2, selected on the first call as in rans-fixed-accuracy.cpp
+template <int ALPHABET_BITS, int STATE_BITS, int ACCURACY_BITS>
+static int encode_baseline(std::span<const typename WideRans<ALPHABET_BITS, STATE_BITS, ACCURACY_BITS>::symbol_t> sequence,
+	std::span<uint8_t> output, const typename WideRans<ALPHABET_BITS, STATE_BITS, ACCURACY_BITS>::Tables& tables
+) {
+	return encode_kernel<ALPHABET_BITS, STATE_BITS, ACCURACY_BITS, false>(sequence, output, tables);
+}
+
+template <int ALPHABET_BITS, int STATE_BITS, int ACCURACY_BITS>
+TARGET_BMI2 static int encode_bmi2(std::span<const typename WideRans<ALPHABET_BITS, STATE_BITS, ACCURACY_BITS>::symbol_t> sequence,
+	std::span<uint8_t> output, const typename WideRans<ALPHABET_BITS, STATE_BITS, ACCURACY_BITS>::Tables& tables
+) {
+	return encode_kernel<ALPHABET_BITS, STATE_BITS, ACCURACY_BITS, true>(sequence, output, tables);
+}
+
+template <int ALPHABET_BITS, int STATE_BITS, int ACCURACY_BITS>
+static bool decode_baseline(const typename WideRans<ALPHABET_BITS, STATE_BITS, ACCURACY_BITS>::Tables& tables, const uint8_t* buffer_begin, const uint8_t* buffer_end,
+	typename WideRans<ALPHABET_BITS, STATE_BITS, ACCURACY_BITS>::symbol_t* out_buf, typename WideRans<ALPHABET_BITS, STATE_BITS, ACCURACY_BITS>::symbol_t* out_end
+) {
+	return decode_kernel<ALPHABET_BITS, STATE_BITS, ACCURACY_BITS, false>(tables, buffer_begin, buffer_end, out_buf, out_end);
+}
+
+template <int ALPHABET_BITS, int STATE_BITS, int ACCURACY_BITS>
+TARGET_BMI2 static bool decode_bmi2(const typename WideRans<ALPHABET_BITS, STATE_BITS, ACCURACY_BITS>::Tables& tables, const uint8_t* buffer_begin, const uint8_t* buffer_end,
+	typename WideRans<ALPHABET_BITS, STATE_BITS, ACCURACY_BITS>::symbol_t* out_buf, typename WideRans<ALPHABET_BITS, STATE_BITS, ACCURACY_BITS>::symbol_t* out_end
+) {
+	return decode_kernel<ALPHABET_BITS, STATE_BITS, ACCURACY_BITS, true>(tables, buffer_begin, buffer_end, out_buf, out_end);
+}
+
+template <int ALPHABET_BITS, int STATE_BITS, int ACCURACY_BITS>
+int WideRans<ALPHABET_BITS, STATE_BITS, ACCURACY_BITS>::encode(std::span<const symbol_t> sequence, std::span<uint8_t> output, const Tables& tables) {
+	typedef int (*EncodeKernel)(std::span<const symbol_t>, std::span<uint8_t>, const Tables&);
+	static const EncodeKernel kernel = cpu_level() >= CPU_BMI2
+		? encode_bmi2<ALPHABET_BITS, STATE_BITS, ACCURACY_BITS> : encode_baseline<ALPHABET_BITS, STATE_BITS, ACCURACY_BITS>;
+	return kernel(sequence, output, tables);
+}
+
+template <int ALPHABET_BITS, int STATE_BITS, int ACCURACY_BITS>
+bool WideRans<ALPHABET_BITS, STATE_BITS, ACCURACY_BITS>::decode(const Tables& tables, const uint8_t* buffer_begin, const uint8_t* buffer_end, symbol_t* out_buf, symbol_t* out_end) {
+	typedef bool (*DecodeKernel)(const Tables&, const uint8_t*, const uint8_t*, symbol_t*, symbol_t*);
+	static const DecodeKernel kernel = cpu_level() >= CPU_BMI2
+		? decode_bmi2<ALPHABET_BITS, STATE_BITS, ACCURACY_BITS> : decode_baseline<ALPHABET_BITS, STATE_BITS, ACCURACY_BITS>;
+	return kernel(tables, buffer_begin, buffer_end, out_buf, out_end);
+}
+
+
+//
+// Explicit instantiations
+//
+
+#define INSTANTIATE_ACCURACIES(A, S) \
+	template struct WideRans<A, S, 1>; template struct WideRans<A, S, 2>; template struct WideRans<A, S, 3>; \
+	template struct WideRans<A, S, 4>; template struct WideRans<A, S, 5>; template struct WideRans<A, S, 6>;
+
+#define INSTANTIATE_STATES(A) \
+	INSTANTIATE_ACCURACIES(A, 10) INSTANTIATE_ACCURACIES(A, 11) INSTANTIATE_ACCURACIES(A, 12) INSTANTIATE_ACCURACIES(A, 13) \
+	INSTANTIATE_ACCURACIES(A, 14) INSTANTIATE_ACCURACIES(A, 15) INSTANTIATE_ACCURACIES(A, 16)
+
+INSTANTIATE_STATES(12)
+INSTANTIATE_STATES(16)
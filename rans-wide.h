@@ -0,0 +1,65 @@
+#pragma once
+
+#include <vector>
+#include <span>
+#include <stdint.h>
+
+#include "sym-stats.h"
+#include "rans-fixed-accuracy.h"
+
+//
+// The fixed-accuracy coder on alphabets of 1 << ALPHABET_BITS symbols (12 or 16 bits in uint16_t), e.g. integer
+// columns or token ids coded directly instead of byte by byte. The tables are sparse: only the present symbols get
+// coding entries, a 2-byte rank per symbol of the alphabet leads the encoder to them and cum2sym holds the ranks.
+// Every present symbol needs a slot, so at most 1 << STATE_BITS distinct symbols can be coded.
+// The model is the frequency table of the stream header (write_freq_table) with a varint symbol count.
+// Explicitly instantiated for ALPHABET_BITS = 12, 16, STATE_BITS = 10..16 and ACCURACY_BITS = 1..6.
+//
+
+template <int ALPHABET_BITS, int STATE_BITS, int ACCURACY_BITS>
+struct WideRans {
+	static constexpr int ALPHABET_SIZE = 1 << ALPHABET_BITS;
+	typedef BasicSymbolStats<ALPHABET_SIZE> Stats;
+	typedef typename Stats::symbol_t symbol_t;
+	typedef FixedAccuracyRans<STATE_BITS, ACCURACY_BITS> Rans;
+	typedef typename Rans::freq_t freq_t;
+	typedef typename Rans::EncSymInfo EncSymInfo;
+
+	struct DecSymInfo {
+		freq_t cumm_freq;
+		freq_t freq;
+		symbol_t sym;
+	};
+
+	struct Tables {
+		std::vector<uint16_t> rank;			// per symbol of the alphabet, 0 for the absent ones
+		std::vector<EncSymInfo> esyms;		// per present symbol
+		std::vector<DecSymInfo> dsyms;		// per present symbol
+		std::vector<uint16_t> cum2sym;		// the rank of the symbol of every slot
+
+		size_t symbols() const { return esyms.size(); }
+		size_t table_bytes() const {
+			return rank.size() * sizeof(uint16_t) + symbols() * (sizeof(EncSymInfo) + sizeof(DecSymInfo)) + cum2sym.size() * sizeof(uint16_t);
+		}
+	};
+
+	// the statistics of the sequence normalized to 1 << STATE_BITS, false if it has more distinct symbols than slots
+	static bool init(std::span<const symbol_t> sequence, Tables& tables);
+	// the tables for stats normalized to 1 << STATE_BITS
+	static void init(const Stats& stats, Tables& tables);
+
+	// the largest output of write_model
+	static size_t max_model_size(const Tables& tables) { return 3 + tables.symbols() * 6; }
+	static size_t write_model(const Tables& tables, uint8_t* out);
+	// rebuilds the tables from the output of write_model, returns its size or 0 if it is malformed or truncated
+	static size_t read_model(const uint8_t* in, size_t size, Tables& tables);
+
+	static size_t max_encoded_size(size_t n) { return Rans::max_encoded_size(n); }
+	// every symbol of the sequence must be present in the tables
+	static int encode(std::span<const symbol_t> sequence, std::span<uint8_t> buf, const Tables& tables);
+	// false if the stream from buffer_begin to buffer_end runs out or is not used up at out_end
+	static bool decode(const Tables& tables, const uint8_t* buffer_begin, const uint8_t* buffer_end, symbol_t* out_buf, symbol_t* out_end);
+};
+
+typedef WideRans<12, 14, 3> Rans12WithAccuracy3;
+typedef WideRans<16, 16, 3> Rans16WithAccuracy3;
@@ -4,6 +4,7 @@
 //
 
 #include <stdint.h>
+#include <string.h>
 #include <vector>
 
 #include "rans.h"
@@ -11,7 +12,6 @@
 
 
 static constexpr uint64_t RANS64_L = 1ull << 31;
-static constexpr uint32_t prob_bits = 14;
 typedef uint64_t Rans64State;
 
 
@@ -19,23 +19,34 @@ typedef uint64_t Rans64State;
 // Encoding
 //
 
+// FRONT writes the words forward from the start of the buffer, the decoder then reads them back from the end
+template <bool FRONT>
 static inline void Rans64EncPutSymbol(Rans64State* r, uint32_t** pptr, Rans64EncSymbol const* sym, uint32_t scale_bits) {
     uint64_t x = *r;
     uint64_t x_max = ((RANS64_L >> scale_bits) << 32) * sym->freq; // this turns into a shift.
     if (x >= x_max) {
-        *pptr -= 1;
-        **pptr = (uint32_t)x;
+        if (FRONT) {
+            **pptr = (uint32_t)x;
+            *pptr += 1;
+        } else {
+            *pptr -= 1;
+            **pptr = (uint32_t)x;
+        }
         x >>= 32;
     }
     *r = ((x / sym->freq) << scale_bits) + (x % sym->freq) + sym->cumm_freq;
 }
 
+template <bool FRONT>
 static inline void Rans64EncFlush(Rans64State* r, uint32_t** pptr) {
     uint64_t x = *r;
 
-    *pptr -= 2;
+    if (!FRONT)
+        *pptr -= 2;
     (*pptr)[0] = (uint32_t)(x >> 0);
     (*pptr)[1] = (uint32_t)(x >> 32);
+    if (FRONT)
+        *pptr += 2;
 }
 
 static inline void Rans64DecSymbolInit(Rans64DecSymbol* s, uint32_t start, uint32_t freq) {
@@ -43,22 +54,42 @@ static inline void Rans64DecSymbolInit(Rans64DecSymbol* s, uint32_t start, uint3
     s->freq = freq;
 }
 
-int encode_rANS(const std::vector<uint8_t>& sequence, std::vector<uint8_t>& buf, const std::vector<Rans64EncSymbol>& esyms) {
+template <int PROB_BITS, bool FRONT>
+static int encode(std::span<const uint8_t> sequence, std::span<uint8_t> buf, std::span<const Rans64EncSymbol> esyms) {
     size_t in_size = sequence.size();
     const uint8_t* in_bytes = sequence.data();
 
     Rans64State rans = RANS64_L;
 
+    uint32_t* out_begin = (uint32_t*)buf.data();
     uint32_t* out_end = (uint32_t*)(buf.data() + buf.size());
-    uint32_t* ptr = out_end;
+    uint32_t* ptr = FRONT ? out_begin : out_end;
     for (size_t i = in_size; i > 0; i--) {
         int s = in_bytes[i - 1];
-        Rans64EncPutSymbol(&rans, &ptr, &esyms[s], prob_bits);
+        Rans64EncPutSymbol<FRONT>(&rans, &ptr, &esyms[s], PROB_BITS);
     }
-    Rans64EncFlush(&rans, &ptr);
-    uint32_t* rans_begin = ptr;
+    Rans64EncFlush<FRONT>(&rans, &ptr);
+
+    return FRONT ? (int)((uint8_t*)ptr - (uint8_t*)out_begin) : (int)((uint8_t*)out_end - (uint8_t*)ptr);
+}
 
-    return (int)((uint8_t*)out_end - (uint8_t*)rans_begin);
+template <int PROB_BITS>
+int Rans64<PROB_BITS>::encode(std::span<const uint8_t> sequence, std::span<uint8_t> buf, std::span<const Rans64EncSymbol> esyms) {
+    return ::encode<PROB_BITS, false>(sequence, buf, esyms);
+}
+
+template <int PROB_BITS>
+int Rans64<PROB_BITS>::encode_front(std::span<const uint8_t> sequence, std::span<uint8_t> buf, std::span<const Rans64EncSymbol> esyms) {
+    return ::encode<PROB_BITS, true>(sequence, buf, esyms);
+}
+
+
+// A symbol adds at most log2(M / freq) + log2(1 + freq / x) <= PROB_BITS + 2^(PROB_BITS - 30) bits to the state
+// and every word takes 32 bits out of it, while the state never drops below RANS64_L
+template <int PROB_BITS>
+size_t Rans64<PROB_BITS>::max_encoded_size(size_t n) {
+    uint64_t bits = (uint64_t)n * PROB_BITS + ((n >> (30 - PROB_BITS)) + 1);
+    return (size_t)(bits / 32) * 4 + 8;
 }
 
 
@@ -71,28 +102,56 @@ static inline void Rans64EncSymbolInit(Rans64EncSymbol* s, uint32_t start, uint3
     s->cumm_freq = start;
 }
 
-Rans64SequenceInfo init_rANS(const std::vector<uint8_t>& sequence) {
-    size_t in_size = sequence.size();
-    const uint8_t* in_bytes = sequence.data();
-
-    static const uint32_t prob_scale = 1 << prob_bits;
+template <int PROB_BITS>
+static void count_stats(std::span<const uint8_t> sequence, const SampleParams* sample, SymbolStats& stats) {
+    static const uint32_t prob_scale = 1 << PROB_BITS;
 
-    SymbolStats stats;
-    stats.count_freqs(in_bytes, in_size);
+    if (sample)
+        stats.count_freqs_sampled(sequence.data(), sequence.size(), sample_for_total(*sample, prob_scale));
+    else
+        stats.count_freqs(sequence.data(), sequence.size());
     stats.normalize_freqs(prob_scale);
+}
 
-    std::vector<uint8_t> cum2sym(prob_scale);
+template <int PROB_BITS>
+static void build_tables(const SymbolStats& stats, Rans64EncSymbol* esyms, Rans64DecSymbol* dsyms, uint8_t* cum2sym) {
     for (int s = 0; s < 256; s++)
-        for (uint32_t i = stats.cum_freqs[s]; i < stats.cum_freqs[s + 1]; i++)
-            cum2sym[i] = s;
+        memset(cum2sym + stats.cum_freqs[s], s, stats.freqs[s]);
 
-    std::vector<Rans64EncSymbol> esyms(256);
-    std::vector<Rans64DecSymbol> dsyms(256);
     for (int i = 0; i < 256; i++) {
-        Rans64EncSymbolInit(&esyms[i], stats.cum_freqs[i], stats.freqs[i], prob_bits);
+        Rans64EncSymbolInit(&esyms[i], stats.cum_freqs[i], stats.freqs[i], PROB_BITS);
         Rans64DecSymbolInit(&dsyms[i], stats.cum_freqs[i], stats.freqs[i]);
     }
-    return { .esyms = esyms, .dsyms = dsyms, .cum2sym = cum2sym };
+}
+
+template <int PROB_BITS>
+Rans64SequenceInfo Rans64<PROB_BITS>::init(std::span<const uint8_t> sequence, const SampleParams* sample) {
+    SymbolStats stats;
+    count_stats<PROB_BITS>(sequence, sample, stats);
+    return init(stats);
+}
+
+template <int PROB_BITS>
+Rans64SequenceInfo Rans64<PROB_BITS>::init(const SymbolStats& stats) {
+    static const uint32_t prob_scale = 1 << PROB_BITS;
+
+    std::vector<uint8_t> cum2sym(prob_scale);
+    std::vector<Rans64EncSymbol> esyms(256);
+    std::vector<Rans64DecSymbol> dsyms(256);
+    build_tables<PROB_BITS>(stats, esyms.data(), dsyms.data(), cum2sym.data());
+    return { .esyms = std::move(esyms), .dsyms = std::move(dsyms), .cum2sym = std::move(cum2sym) };
+}
+
+template <int PROB_BITS>
+void Rans64<PROB_BITS>::Context::init(std::span<const uint8_t> sequence, const SampleParams* sample) {
+    SymbolStats stats;
+    count_stats<PROB_BITS>(sequence, sample, stats);
+    init(stats);
+}
+
+template <int PROB_BITS>
+void Rans64<PROB_BITS>::Context::init(const SymbolStats& stats) {
+    build_tables<PROB_BITS>(stats, esyms, dsyms, cum2sym);
 }
 
 
@@ -113,27 +172,74 @@ static inline uint32_t Rans64DecGet(Rans64State* r, uint32_t scale_bits) {
     return *r & ((1u << scale_bits) - 1);
 }
 
-void decode_rANS(const std::vector<Rans64DecSymbol> & dsyms, const std::vector<uint8_t> & cum2sym, 
-    const uint8_t * rans_begin, uint8_t *dec_bytes, size_t original_size
+template <int PROB_BITS>
+bool Rans64<PROB_BITS>::decode(std::span<const Rans64DecSymbol> dsyms, std::span<const uint8_t> cum2sym,
+    const uint8_t * rans_begin, const uint8_t* rans_end, uint8_t *dec_bytes, size_t original_size
 ) {
+    if (rans_end - rans_begin < 8)
+        return false;
     Rans64State rans;
     uint32_t* ptr = (uint32_t *)rans_begin;
+    const uint32_t* end = ptr + (rans_end - rans_begin) / 4;
     Rans64DecInit(&rans, &ptr);
 
     for (size_t i = 0; i < original_size; i++) {
-        uint32_t s = cum2sym[Rans64DecGet(&rans, prob_bits)];
+        uint32_t s = cum2sym[Rans64DecGet(&rans, PROB_BITS)];
         dec_bytes[i] = (uint8_t)s;
 
-        uint64_t mask = (1ull << prob_bits) - 1;
+        uint64_t mask = (1ull << PROB_BITS) - 1;
 
         uint64_t x = rans;
-        x = dsyms[s].freq * (x >> prob_bits) + (x & mask) - dsyms[s].start;
+        x = dsyms[s].freq * (x >> PROB_BITS) + (x & mask) - dsyms[s].start;
 
-        if (x < RANS64_L) {
+        if (x < RANS64_L && ptr < end) {
             x = (x << 32) | *ptr;
             ptr += 1;
         }
 
         rans = x;
     }
-}
\ No newline at end of file
+    return ptr == end && rans == RANS64_L;
+}
+
+template <int PROB_BITS>
+bool Rans64<PROB_BITS>::decode_front(std::span<const Rans64DecSymbol> dsyms, std::span<const uint8_t> cum2sym,
+    const uint8_t* rans_begin, const uint8_t* rans_end, uint8_t* dec_bytes, size_t original_size
+) {
+    if (rans_end - rans_begin < 8)
+        return false;
+    uint32_t* ptr = (uint32_t*)rans_end - 2;
+    const uint32_t* begin = (const uint32_t*)rans_end - (rans_end - rans_begin) / 4;
+    Rans64State rans = (uint64_t)ptr[0] | ((uint64_t)ptr[1] << 32);
+
+    for (size_t i = 0; i < original_size; i++) {
+        uint32_t s = cum2sym[Rans64DecGet(&rans, PROB_BITS)];
+        dec_bytes[i] = (uint8_t)s;
+
+        uint64_t mask = (1ull << PROB_BITS) - 1;
+
+        uint64_t x = rans;
+        x = dsyms[s].freq * (x >> PROB_BITS) + (x & mask) - dsyms[s].start;
+
+        if (x < RANS64_L && ptr > begin) {
+            ptr -= 1;
+            x = (x << 32) | *ptr;
+        }
+
+        rans = x;
+    }
+    return ptr == begin && rans == RANS64_L;
+}
+
+
+//
+// Explicit instantiations
+//
+
+template struct Rans64<10>;
+template struct Rans64<11>;
+template struct Rans64<12>;
+template struct Rans64<13>;
+template struct Rans64<14>;
+template struct Rans64<15>;
+template struct Rans64<16>;
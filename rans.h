@@ -6,6 +6,7 @@
 #pragma once
 
 #include <vector>
+#include <span>
 #include <stdint.h>
 
 
@@ -25,7 +26,79 @@ typedef struct {
     std::vector<uint8_t> cum2sym;
 } Rans64SequenceInfo;
 
-Rans64SequenceInfo init_rANS(const std::vector<uint8_t>& sequence);
-int encode_rANS(const std::vector<uint8_t>& sequence, std::vector<uint8_t>& buf, const std::vector<Rans64EncSymbol>& esyms);
-void decode_rANS(const std::vector<Rans64DecSymbol>& dsyms, const std::vector<uint8_t>& cum2sym,
-    const uint8_t* rans_begin, uint8_t* dec_bytes, size_t original_size);
+// the precision of the free functions below and of the streams of the block container
+static constexpr uint32_t RANS64_PROB_BITS = 14;
+
+struct SampleParams;
+template <int ALPHABET_SIZE> struct BasicSymbolStats;
+typedef BasicSymbolStats<256> SymbolStats;
+
+// The 64-bit rANS with the probabilities in PROB_BITS bits: smaller precisions keep cum2sym in L1, larger ones
+// code skewed data closer to its entropy. Explicitly instantiated for PROB_BITS = 10..16.
+template <int PROB_BITS>
+struct Rans64 {
+    static_assert(PROB_BITS >= 10 && PROB_BITS <= 16, "");
+
+    // the statistics come from count_freqs_sampled when sample is set
+    static Rans64SequenceInfo init(std::span<const uint8_t> sequence, const SampleParams* sample = nullptr);
+    // the tables for stats normalized to 1 << PROB_BITS
+    static Rans64SequenceInfo init(const SymbolStats& stats);
+    // the output is written to the end of buf, returns the number of bytes used
+    static int encode(std::span<const uint8_t> sequence, std::span<uint8_t> buf, std::span<const Rans64EncSymbol> esyms);
+    // reads the whole words from rans_begin to rans_end and nothing past them, false if the stream runs out
+    // before original_size symbols or is not used up exactly there
+    static bool decode(std::span<const Rans64DecSymbol> dsyms, std::span<const uint8_t> cum2sym,
+        const uint8_t* rans_begin, const uint8_t* rans_end, uint8_t* dec_bytes, size_t original_size);
+
+    // the same words in the reverse order, written from the start of buf (4-aligned) and read back from rans_end
+    static int encode_front(std::span<const uint8_t> sequence, std::span<uint8_t> buf, std::span<const Rans64EncSymbol> esyms);
+    static bool decode_front(std::span<const Rans64DecSymbol> dsyms, std::span<const uint8_t> cum2sym,
+        const uint8_t* rans_begin, const uint8_t* rans_end, uint8_t* dec_bytes, size_t original_size);
+
+    // the largest output of encode, encode_front and the fast rANS for n symbols (a multiple of 4)
+    static size_t max_encoded_size(size_t n);
+
+    // the tables of init in fixed storage that is rebuilt in place, so coding a message does not allocate
+    struct Context {
+        alignas(64) Rans64EncSymbol esyms[256];
+        alignas(64) Rans64DecSymbol dsyms[256];
+        alignas(64) uint8_t cum2sym[1 << PROB_BITS];
+
+        void init(std::span<const uint8_t> sequence, const SampleParams* sample = nullptr);
+        void init(const SymbolStats& stats);
+    };
+};
+
+typedef Rans64<RANS64_PROB_BITS>::Context Rans64Context;
+
+inline Rans64SequenceInfo init_rANS(std::span<const uint8_t> sequence, const SampleParams* sample = nullptr) {
+    return Rans64<RANS64_PROB_BITS>::init(sequence, sample);
+}
+
+inline Rans64SequenceInfo init_rANS(const SymbolStats& stats) {
+    return Rans64<RANS64_PROB_BITS>::init(stats);
+}
+
+inline int encode_rANS(std::span<const uint8_t> sequence, std::span<uint8_t> buf, std::span<const Rans64EncSymbol> esyms) {
+    return Rans64<RANS64_PROB_BITS>::encode(sequence, buf, esyms);
+}
+
+inline bool decode_rANS(std::span<const Rans64DecSymbol> dsyms, std::span<const uint8_t> cum2sym,
+    const uint8_t* rans_begin, const uint8_t* rans_end, uint8_t* dec_bytes, size_t original_size
+) {
+    return Rans64<RANS64_PROB_BITS>::decode(dsyms, cum2sym, rans_begin, rans_end, dec_bytes, original_size);
+}
+
+inline int encode_rANS_front(std::span<const uint8_t> sequence, std::span<uint8_t> buf, std::span<const Rans64EncSymbol> esyms) {
+    return Rans64<RANS64_PROB_BITS>::encode_front(sequence, buf, esyms);
+}
+
+inline bool decode_rANS_front(std::span<const Rans64DecSymbol> dsyms, std::span<const uint8_t> cum2sym,
+    const uint8_t* rans_begin, const uint8_t* rans_end, uint8_t* dec_bytes, size_t original_size
+) {
+    return Rans64<RANS64_PROB_BITS>::decode_front(dsyms, cum2sym, rans_begin, rans_end, dec_bytes, original_size);
+}
+
+inline size_t max_encoded_size_rANS(size_t n) {
+    return Rans64<RANS64_PROB_BITS>::max_encoded_size(n);
+}
@@ -0,0 +1,137 @@
+#include <stdint.h>
+#include <string.h>
+#include <algorithm>
+#include <vector>
+
+#include "stream-coder.h"
+#include "stream-header.h"
+
+//
+// Encoding
+//
+
+StreamEncoder::StreamEncoder(const ContainerParams& params) : params(params), error(!supported_container_params(params)) {
+    this->params.block_size = std::max<size_t>(params.block_size, 1);
+    if (!error)
+        chunk.reserve(this->params.block_size);
+}
+
+size_t StreamEncoder::push(const uint8_t* in, size_t size) {
+    size_t taken = 0;
+    while (!finished && !error && taken < size) {
+        if (chunk.size() == params.block_size) {
+            refill();
+            if (chunk.size() == params.block_size)
+                break;
+        }
+        size_t len = std::min(size - taken, params.block_size - chunk.size());
+        chunk.insert(chunk.end(), in + taken, in + taken + len);
+        taken += len;
+    }
+    in_bytes += taken;
+    return taken;
+}
+
+void StreamEncoder::finish() {
+    finished = true;
+}
+
+void StreamEncoder::refill() {
+    if (error || output_pos < output.size())
+        return;
+    output.clear();
+    output_pos = 0;
+    if (chunk.size() == params.block_size || (finished && !chunk.empty())) {
+        encode_block(chunk.data(), chunk.size(), params, frame);
+        uint8_t frame_size[10];
+        output.assign(frame_size, put_varint(frame_size, frame.size()));
+        output.insert(output.end(), frame.begin(), frame.end());
+        chunk.clear();
+    } else if (finished && !end_written) {
+        output.push_back(0);
+        end_written = true;
+    }
+}
+
+size_t StreamEncoder::pull(uint8_t* out, size_t capacity) {
+    size_t written = 0;
+    while (written < capacity) {
+        refill();
+        if (output_pos == output.size())
+            break;
+        size_t len = std::min(capacity - written, output.size() - output_pos);
+        memcpy(out + written, output.data() + output_pos, len);
+        output_pos += len;
+        written += len;
+    }
+    out_bytes += written;
+    return written;
+}
+
+
+//
+// Decoding
+//
+
+StreamDecoder::StreamDecoder(size_t max_chunk_size)
+    : max_chunk_size(max_chunk_size), max_frame_size(MAX_STREAM_HEADER_SIZE + max_chunk_size * 2 + 64) {
+}
+
+size_t StreamDecoder::push(const uint8_t* in, size_t size) {
+    size_t taken = 0;
+    while (!finished && !error && output_pos == output.size() && taken < size) {
+        if (!in_frame) {
+            // the frame size varint is collected byte by byte
+            uint8_t byte = in[taken++];
+            frame.push_back(byte);
+            if (byte & 0x80) {
+                if (frame.size() == 10)
+                    error = true;
+                continue;
+            }
+            get_varint(frame.data(), frame.data() + frame.size(), frame_size);
+            frame.clear();
+            if (frame_size == 0)
+                finished = true;
+            else if (frame_size > max_frame_size)
+                error = true;
+            else
+                in_frame = true;
+            continue;
+        }
+
+        size_t len = (size_t)std::min<uint64_t>(size - taken, frame_size - frame.size());
+        frame.insert(frame.end(), in + taken, in + taken + len);
+        taken += len;
+        if (frame.size() == frame_size) {
+            if (!decode_frame()) {
+                error = true;
+                output.clear();
+                output_pos = 0;
+            }
+            frame.clear();
+            in_frame = false;
+        }
+    }
+    in_bytes += taken;
+    return taken;
+}
+
+bool StreamDecoder::decode_frame() {
+    StreamHeader header;
+    size_t header_size = read_stream_header(frame.data(), frame.size(), header);
+    if (!header_size || header.original_size > max_chunk_size || header.encoded_size != frame.size() - header_size)
+        return false;
+    output.resize(header.original_size);
+    output_pos = 0;
+    return decoder.decode(header, frame.data() + header_size, frame.data() + frame.size(), output.data(), output.size());
+}
+
+size_t StreamDecoder::pull(uint8_t* out, size_t capacity) {
+    size_t len = std::min(capacity, output.size() - output_pos);
+    if (len)
+        memcpy(out, output.data() + output_pos, len);
+    output_pos += len;
+    out_bytes += len;
+    return len;
+}
@@ -0,0 +1,82 @@
+//
+// Streaming coder with push-style input and pull-style output in bounded memory: the input is cut into chunks of
+// ContainerParams::block_size bytes which are coded as the blocks of the container (each with its own stream header).
+//
+// frame:   varint frame size + stream header + payload
+// end:     varint 0
+//
+// The encoder holds one chunk of the input and one frame, the decoder one frame and one chunk of the output,
+// whatever the length of the stream. The decoder checks the framing and the sizes, and a payload that runs out
+// before the size of its chunk fails the stream instead of being read past.
+//
+
+#pragma once
+
+#include <vector>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "block-container.h"
+
+class StreamEncoder {
+public:
+    explicit StreamEncoder(const ContainerParams& params = {});
+
+    // returns the number of bytes taken, less than size while a coded frame waits to be pulled
+    size_t push(const uint8_t* in, size_t size);
+    // no more input: codes the last chunk and the end of the stream
+    void finish();
+    // returns the number of bytes written to out
+    size_t pull(uint8_t* out, size_t capacity);
+    // finished and everything is pulled
+    bool done() const { return end_written && output_pos == output.size(); }
+    // the parameters are not supported (supported_container_params), nothing is taken or coded
+    bool failed() const { return error; }
+
+    uint64_t total_in() const { return in_bytes; }
+    uint64_t total_out() const { return out_bytes; }
+
+private:
+    // codes the chunk (or the end of the stream) when the previous output is pulled
+    void refill();
+
+    ContainerParams params;
+    std::vector<uint8_t> chunk;
+    std::vector<uint8_t> frame;
+    std::vector<uint8_t> output;
+    size_t output_pos = 0;
+    bool finished = false, end_written = false, error = false;
+    uint64_t in_bytes = 0, out_bytes = 0;
+};
+
+class StreamDecoder {
+public:
+    // frames which decode to more than max_chunk_size bytes are rejected
+    explicit StreamDecoder(size_t max_chunk_size = ContainerParams().block_size);
+
+    // returns the number of bytes taken, less than size while a decoded chunk waits to be pulled or after an error
+    size_t push(const uint8_t* in, size_t size);
+    // returns the number of bytes written to out
+    size_t pull(uint8_t* out, size_t capacity);
+    // the end of the stream is reached and everything is pulled
+    bool done() const { return finished && output_pos == output.size(); }
+    // a malformed frame was met, the decoding stops
+    bool failed() const { return error; }
+
+    uint64_t total_in() const { return in_bytes; }
+    uint64_t total_out() const { return out_bytes; }
+
+private:
+    bool decode_frame();
+
+    size_t max_chunk_size;
+    size_t max_frame_size;
+    BlockDecoder decoder;
+    std::vector<uint8_t> frame;     // the bytes of the frame size varint until it ends, then the frame
+    uint64_t frame_size = 0;
+    bool in_frame = false;
+    std::vector<uint8_t> output;
+    size_t output_pos = 0;
+    bool finished = false, error = false;
+    uint64_t in_bytes = 0, out_bytes = 0;
+};
@@ -0,0 +1,102 @@
+#include <stdint.h>
+#include <string.h>
+#include <algorithm>
+#include <bit>
+
+#include "stream-header.h"
+
+uint8_t* write_freq_table(const uint32_t* freqs, uint8_t* out) {
+    uint8_t* ptr = out;
+    int count = 0, last = 0;
+    for (int s = 0; s < 256; s++) {
+        if (freqs[s]) {
+            count++;
+            last = s;
+        }
+    }
+    *ptr++ = (uint8_t)(count - 1);
+
+    int prev = -1;
+    for (int s = 0; s <= last; s++) {
+        uint32_t freq = freqs[s];
+        if (!freq)
+            continue;
+        uint32_t gap = s - prev - 1;
+        uint64_t code = (uint64_t)(s == last ? 0 : freq - 1) << 1 | (gap != 0);
+        ptr = put_varint(ptr, code);
+        if (gap)
+            ptr = put_varint(ptr, gap - 1);
+        prev = s;
+    }
+    return ptr;
+}
+
+const uint8_t* read_freq_table(const uint8_t* in, const uint8_t* end, uint32_t total, SymbolStats& stats) {
+    const uint8_t* ptr = in;
+    uint32_t* freqs = stats.freqs;
+    uint32_t* cum_freqs = stats.cum_freqs;
+    if (ptr == end)
+        return nullptr;
+    memset(freqs, 0, sizeof(stats.freqs));
+    int count = *ptr++ + 1;
+    uint32_t sum = 0;
+    int s = -1;
+    for (int i = 0; i < count; i++) {
+        uint64_t code, gap = 0;
+        if (!(ptr = get_varint(ptr, end, code)))
+            return nullptr;
+        if ((code & 1) && !(ptr = get_varint(ptr, end, gap)))
+            return nullptr;
+        s += 1 + (int)(code & 1) + (int)std::min<uint64_t>(gap, 256);
+        if (s > 255)
+            return nullptr;
+        uint64_t freq = i + 1 == count ? (uint64_t)total - sum : (code >> 1) + 1;
+        if (freq == 0 || freq > total - sum)
+            return nullptr;
+        freqs[s] = (uint32_t)freq;
+        sum += (uint32_t)freq;
+    }
+
+    cum_freqs[0] = 0;
+    for (int j = 0; j < 256; j++)
+        cum_freqs[j + 1] = cum_freqs[j] + freqs[j];
+    return ptr;
+}
+
+size_t write_stream_header(const StreamHeader& header, uint8_t* out) {
+    uint8_t* ptr = out;
+    *ptr++ = header.variant | std::countr_zero((unsigned)header.ways) << 4;
+    *ptr++ = header.prob_bits | header.accuracy_bits << 5;
+    ptr = put_varint(ptr, header.original_size);
+    ptr = put_varint(ptr, header.encoded_size);
+    if (header.original_size == 0 || header.variant == STREAM_STORED)
+        return ptr - out;
+    ptr = write_freq_table(header.stats.freqs, ptr);
+    return ptr - out;
+}
+
+size_t read_stream_header(const uint8_t* in, size_t size, StreamHeader& header) {
+    const uint8_t* ptr = in;
+    const uint8_t* end = in + size;
+    if (size < 3)
+        return 0;
+
+    uint8_t variant = *ptr & 0xF;
+    uint8_t log_ways = *ptr++ >> 4;
+    header.prob_bits = *ptr & 0x1F;
+    header.accuracy_bits = *ptr++ >> 5;
+    if (variant > STREAM_RLE || log_ways > 3 || header.prob_bits > 16)
+        return 0;
+    header.ways = 1 << log_ways;
+    header.variant = (StreamVariant)variant;
+    if (!(ptr = get_varint(ptr, end, header.original_size)) || !(ptr = get_varint(ptr, end, header.encoded_size)))
+        return 0;
+    if (header.original_size == 0 || header.variant == STREAM_STORED) {
+        memset(&header.stats, 0, sizeof(header.stats));
+        return ptr - in;
+    }
+
+    if (!(ptr = read_freq_table(ptr, end, 1u << header.prob_bits, header.stats)))
+        return 0;
+    return ptr - in;
+}
@@ -0,0 +1,76 @@
+//
+// Compact header that makes an encoded stream self-describing: the coder variant, its parameters, the sizes and
+// the normalized frequency table. The present symbols are delta coded, their frequencies are varints and the
+// frequency of the last present symbol is implied by the total.
+//
+// byte 0:      variant | log2(ways) << 4
+// byte 1:      prob_bits (STATE_BITS for the fixed-accuracy coders) | accuracy_bits << 5
+// varint:      original_size
+// varint:      encoded_size
+// (the rest is omitted when original_size is 0 and for STREAM_STORED)
+// byte:        number of present symbols - 1
+// per symbol:  varint (freq - 1) << 1 | has_gap, followed by varint gap - 1 if has_gap (freq - 1 is 0 for the last)
+//
+
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "sym-stats.h"
+
+enum StreamVariant : uint8_t {
+    STREAM_RANS64 = 0,
+    STREAM_RANS64_FAST = 1,
+    STREAM_RANS_AVX2 = 2,
+    STREAM_FIXED_ACCURACY = 3,
+    STREAM_STORED = 4,          // the payload is the original bytes
+    STREAM_RLE = 5              // no payload, the only symbol of the frequency table repeated original_size times
+};
+
+struct StreamHeader {
+    StreamVariant variant;
+    uint8_t prob_bits;
+    uint8_t accuracy_bits;      // 0 for the variants without fixed accuracy
+    uint8_t ways;               // 1, 2, 4 or 8 interleaved states
+    uint64_t original_size;
+    uint64_t encoded_size;
+    SymbolStats stats;          // normalized to 1 << prob_bits, cum_freqs are filled by the parser
+};
+
+// 1 + 256 * (3 + 2)
+static constexpr size_t MAX_FREQ_TABLE_SIZE = 1281;
+// 2 + 2 * 10 + MAX_FREQ_TABLE_SIZE
+static constexpr size_t MAX_STREAM_HEADER_SIZE = 1303;
+
+inline uint8_t* put_varint(uint8_t* out, uint64_t value) {
+    while (value >= 0x80) {
+        *out++ = (uint8_t)value | 0x80;
+        value >>= 7;
+    }
+    *out++ = (uint8_t)value;
+    return out;
+}
+
+// nullptr if the varint does not end before end or does not fit 64 bits
+inline const uint8_t* get_varint(const uint8_t* in, const uint8_t* end, uint64_t& value) {
+    value = 0;
+    for (int shift = 0; in < end && shift < 64; shift += 7) {
+        uint8_t byte = *in++;
+        value |= (uint64_t)(byte & 0x7F) << shift;
+        if (!(byte & 0x80))
+            return in;
+    }
+    return nullptr;
+}
+
+// the frequency table of the header alone, for the streams that store several tables: freqs must have at least
+// one present symbol, out must hold MAX_FREQ_TABLE_SIZE bytes; returns the end of the table
+uint8_t* write_freq_table(const uint32_t* freqs, uint8_t* out);
+// fills freqs and cum_freqs of stats, the frequencies sum to total; nullptr if the table is malformed or truncated
+const uint8_t* read_freq_table(const uint8_t* in, const uint8_t* end, uint32_t total, SymbolStats& stats);
+
+// returns the header size, out must hold MAX_STREAM_HEADER_SIZE bytes
+size_t write_stream_header(const StreamHeader& header, uint8_t* out);
+// returns the header size or 0 if the header is malformed or truncated
+size_t read_stream_header(const uint8_t* in, size_t size, StreamHeader& header);
@@ -4,34 +4,196 @@
 //
 
 #include <stdint.h>
+#include <string.h>
+#include <algorithm>
+#include <cmath>
+#include <thread>
+#include <vector>
+
 #include "sym-stats.h"
 
-void SymbolStats::count_freqs(uint8_t const* in, size_t nbytes) {
-    for (int i = 0; i < 256; i++)
-        freqs[i] = 0;
+// Repeated bytes make consecutive increments of one counter wait for each other (store-to-load forwarding),
+// so the bytes of every 64-bit word go to HIST_TABLES different sub-tables which are summed up in the end
+static constexpr int HIST_TABLES = 4;
+
+// the scratch arrays of the byte and 12-bit alphabets stay on the stack, the larger ones go to the heap
+template <typename T, int N, bool ON_STACK = (N * sizeof(T) <= 65536)>
+class ScratchArray {
+public:
+    T* data() { return items; }
+    T& operator[](size_t i) { return items[i]; }
+
+private:
+    T items[N];
+};
+
+template <typename T, int N>
+class ScratchArray<T, N, false> {
+public:
+    T* data() { return items.data(); }
+    T& operator[](size_t i) { return items[i]; }
+
+private:
+    std::vector<T> items = std::vector<T>(N);
+};
+
+static void count_bytes_range(uint8_t const* in, size_t nbytes, uint32_t* freqs) {
+    uint32_t tables[HIST_TABLES][256];
+    memset(tables, 0, sizeof(tables));
+
+    size_t i = 0;
+    for (; i + 8 <= nbytes; i += 8) {
+        uint64_t word;
+        memcpy(&word, in + i, sizeof(uint64_t));
+        for (int k = 0; k < 8; k++)
+            tables[k % HIST_TABLES][(word >> (8 * k)) & 0xFF]++;
+    }
+    for (; i < nbytes; i++)
+        tables[0][in[i]]++;
+
+    for (int s = 0; s < 256; s++) {
+        uint32_t freq = 0;
+        for (int k = 0; k < HIST_TABLES; k++)
+            freq += tables[k][s];
+        freqs[s] = freq;
+    }
+}
+
+// repeated symbols are rarer in the wide alphabets and the sub-tables of 65536 symbols would not fit the L2 cache,
+// so they get HIST_TABLES sub-tables only up to 4096 symbols
+template <int ALPHABET_SIZE>
+static void count_freqs_range(typename BasicSymbolStats<ALPHABET_SIZE>::symbol_t const* in, size_t n, uint32_t* freqs) {
+    if constexpr (ALPHABET_SIZE == 256) {
+        count_bytes_range(in, n, freqs);
+    } else {
+        constexpr int TABLES = ALPHABET_SIZE <= 4096 ? HIST_TABLES : 1;
+        ScratchArray<uint32_t, TABLES * ALPHABET_SIZE> tables;
+        memset(tables.data(), 0, TABLES * ALPHABET_SIZE * sizeof(uint32_t));
+
+        size_t i = 0;
+        for (; i + TABLES <= n; i += TABLES) {
+            for (int k = 0; k < TABLES; k++)
+                tables[k * ALPHABET_SIZE + in[i + k]]++;
+        }
+        for (; i < n; i++)
+            tables[in[i]]++;
+
+        for (int s = 0; s < ALPHABET_SIZE; s++) {
+            uint32_t freq = 0;
+            for (int k = 0; k < TABLES; k++)
+                freq += tables[k * ALPHABET_SIZE + s];
+            freqs[s] = freq;
+        }
+    }
+}
+
+template <int ALPHABET_SIZE>
+void BasicSymbolStats<ALPHABET_SIZE>::count_freqs(symbol_t const* in, size_t n) {
+    count_freqs_range<ALPHABET_SIZE>(in, n, freqs);
+}
+
+template <int ALPHABET_SIZE>
+void BasicSymbolStats<ALPHABET_SIZE>::count_freqs_parallel(symbol_t const* in, size_t nbytes, unsigned threads, size_t min_bytes_per_thread) {
+    if (threads == 0)
+        threads = std::max(1u, std::thread::hardware_concurrency());
+    threads = (unsigned)std::min<size_t>(threads, nbytes / std::max<size_t>(min_bytes_per_thread, 1));
+    if (threads < 2) {
+        count_freqs(in, nbytes);
+        return;
+    }
+
+    std::vector<uint32_t> partial(ALPHABET_SIZE * (size_t)threads);
+    std::vector<std::thread> workers;
+    size_t chunk = nbytes / threads;
+    for (unsigned t = 0; t < threads; t++) {
+        size_t begin = t * chunk;
+        size_t end = t + 1 == threads ? nbytes : begin + chunk;
+        workers.emplace_back(count_freqs_range<ALPHABET_SIZE>, in + begin, end - begin, partial.data() + ALPHABET_SIZE * t);
+    }
+    for (auto& worker : workers)
+        worker.join();
 
-    for (size_t i = 0; i < nbytes; i++)
-        freqs[in[i]]++;
+    for (int s = 0; s < ALPHABET_SIZE; s++) {
+        freqs[s] = 0;
+        for (unsigned t = 0; t < threads; t++)
+            freqs[s] += partial[ALPHABET_SIZE * t + s];
+    }
 }
 
-void SymbolStats::calc_cum_freqs() {
+template <int ALPHABET_SIZE>
+void BasicSymbolStats<ALPHABET_SIZE>::count_freqs_sampled(symbol_t const* in, size_t nbytes, const SampleParams& params) {
+    size_t block_size = std::max<size_t>(params.block_size, 1);
+    size_t group_size = block_size * std::max<uint32_t>(params.rate, 1);
+    if (nbytes <= group_size) {
+        count_freqs(in, nbytes);
+        return;
+    }
+
+    ScratchArray<uint32_t, ALPHABET_SIZE> block_freqs;
+    memset(freqs, 0, sizeof(freqs));
+    uint64_t rng = params.seed;
+    for (size_t group = 0; group < nbytes; group += group_size) {
+        size_t begin = group;
+        if (params.random) {
+            // splitmix64
+            uint64_t z = (rng += 0x9E3779B97F4A7C15ull);
+            z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ull;
+            z = (z ^ (z >> 27)) * 0x94D049BB133111EBull;
+            z ^= z >> 31;
+            begin += (z % std::max<uint32_t>(params.rate, 1)) * block_size;
+        }
+        if (begin >= nbytes)
+            continue;
+        count_freqs_range<ALPHABET_SIZE>(in + begin, std::min(block_size, nbytes - begin), block_freqs.data());
+        for (int s = 0; s < ALPHABET_SIZE; s++)
+            freqs[s] += block_freqs[s];
+    }
+
+    // without an escape symbol, the unseen symbols still take one slot each after the normalization, so there
+    // must be few of them: 65536 of them could not even be normalized below 16 bits
+    if ((size_t)std::count(freqs, freqs + ALPHABET_SIZE, 0u) > params.max_unseen) {
+        count_freqs(in, nbytes);
+        return;
+    }
+    for (int s = 0; s < ALPHABET_SIZE; s++)
+        freqs[s] = std::max<uint32_t>(freqs[s], 1);
+}
+
+// the number of symbols with a non-zero count
+template <int ALPHABET_SIZE>
+static size_t present_symbols(const uint32_t* freqs) {
+    return ALPHABET_SIZE - std::count(freqs, freqs + ALPHABET_SIZE, 0u);
+}
+
+template <int ALPHABET_SIZE>
+void BasicSymbolStats<ALPHABET_SIZE>::calc_cum_freqs() {
     cum_freqs[0] = 0;
-    for (int i = 0; i < 256; i++)
+    for (int i = 0; i < ALPHABET_SIZE; i++)
         cum_freqs[i + 1] = cum_freqs[i] + freqs[i];
 }
 
-void SymbolStats::normalize_freqs(uint32_t target_total) {
+template <int ALPHABET_SIZE>
+bool BasicSymbolStats<ALPHABET_SIZE>::normalize_freqs(uint32_t target_total, NormalizeMethod method) {
+    if (method == NORMALIZE_STEAL)
+        return normalize_freqs_steal(target_total);
+    return normalize_freqs_min_cost(target_total);
+}
+
+template <int ALPHABET_SIZE>
+bool BasicSymbolStats<ALPHABET_SIZE>::normalize_freqs_steal(uint32_t target_total) {
+    if (present_symbols<ALPHABET_SIZE>(freqs) > target_total)
+        return false;
     calc_cum_freqs();
-    uint32_t cur_total = cum_freqs[256];
+    uint32_t cur_total = cum_freqs[ALPHABET_SIZE];
 
-    for (int i = 1; i <= 256; i++)
+    for (int i = 1; i <= ALPHABET_SIZE; i++)
         cum_freqs[i] = ((uint64_t)target_total * cum_freqs[i]) / cur_total;
 
-    for (int i = 0; i < 256; i++) {
+    for (int i = 0; i < ALPHABET_SIZE; i++) {
         if (freqs[i] && cum_freqs[i + 1] == cum_freqs[i]) {
             uint32_t best_freq = ~0u;
             int best_steal = -1;
-            for (int j = 0; j < 256; j++) {
+            for (int j = 0; j < ALPHABET_SIZE; j++) {
                 uint32_t freq = cum_freqs[j + 1] - cum_freqs[j];
                 if (freq > 1 && freq < best_freq) {
                     best_freq = freq;
@@ -48,7 +210,175 @@ void SymbolStats::normalize_freqs(uint32_t target_total) {
         }
     }
 
-    for (int i = 0; i < 256; i++) {
+    for (int i = 0; i < ALPHABET_SIZE; i++) {
         freqs[i] = cum_freqs[i + 1] - cum_freqs[i];
     }
+    return true;
+}
+
+// log2((f + 1) / f) for f >= 1: tabulated for small f, the series of log(1 + 1 / f) is exact to 1e-11 for the rest
+static double log2_ratio(uint32_t f) {
+    static constexpr uint32_t TABLE_SIZE = 4096;
+    static const std::vector<double> table = [] {
+        std::vector<double> t(TABLE_SIZE);
+        for (uint32_t i = 1; i < TABLE_SIZE; i++)
+            t[i] = std::log2((i + 1.0) / i);
+        return t;
+    }();
+    if (f < TABLE_SIZE)
+        return table[f];
+    double x = 1.0 / f;
+    return x * (1 - x * (0.5 - x * (1.0 / 3))) * 1.4426950408889634;   // 1 / ln(2)
+}
+
+// heap entries remember the frequency they were computed for, outdated ones are skipped
+struct CostEntry {
+    double cost;
+    int sym;
+    uint32_t freq;
+};
+
+// a binary heap in a fixed buffer so normalization does not allocate for bytes: every symbol has at most one valid
+// entry, so dropping the outdated ones when the buffer runs full always leaves room
+template <typename Compare, int ALPHABET_SIZE>
+class CostHeap {
+public:
+    CostHeap(Compare cmp, const uint32_t* freqs) : cmp(cmp), freqs(freqs) {}
+
+    void push(const CostEntry& e) {
+        if (size == CAPACITY) {
+            size = std::remove_if(items, items + size, [&](const CostEntry& x) { return outdated(x); }) - items;
+            std::make_heap(items, items + size, cmp);
+        }
+        items[size++] = e;
+        std::push_heap(items, items + size, cmp);
+    }
+
+    // the symbol of the best valid entry or -1
+    int top_valid() {
+        while (size && outdated(items[0])) {
+            std::pop_heap(items, items + size, cmp);
+            size--;
+        }
+        return size ? items[0].sym : -1;
+    }
+
+    double top_cost() const { return items[0].cost; }
+
+private:
+    static constexpr int CAPACITY = std::max(1024, 2 * ALPHABET_SIZE);
+
+    bool outdated(const CostEntry& e) const { return e.freq != freqs[e.sym]; }
+
+    ScratchArray<CostEntry, CAPACITY> storage;
+    CostEntry* items = storage.data();
+    size_t size = 0;
+    Compare cmp;
+    const uint32_t* freqs;
+};
+
+// The code length sum(count[s] * log2(target_total / freq[s])) is convex in every freq[s], so it is minimal when
+// no unit of frequency can move to a symbol whose gain count[s] * log2((freq[s] + 1) / freq[s]) exceeds the loss
+// count[s] * log2(freq[s] / (freq[s] - 1)) of the symbol giving it. The start is the rounded proportional share
+// after the symbols that would get less than 1 are fixed at 1, so only a few units are then moved between
+// the symbols through two heaps: O(n log n) in total.
+template <int ALPHABET_SIZE>
+bool BasicSymbolStats<ALPHABET_SIZE>::normalize_freqs_min_cost(uint32_t target_total) {
+    // every present symbol keeps at least one unit, there would be no symbol left to take a unit from
+    if (present_symbols<ALPHABET_SIZE>(freqs) > target_total)
+        return false;
+    calc_cum_freqs();
+    uint64_t cur_total = cum_freqs[ALPHABET_SIZE];
+    if (cur_total == 0)
+        return true;
+
+    ScratchArray<uint32_t, ALPHABET_SIZE> counts;
+    ScratchArray<bool, ALPHABET_SIZE> fixed;
+    for (int i = 0; i < ALPHABET_SIZE; i++) {
+        counts[i] = freqs[i];
+        fixed[i] = counts[i] == 0;
+        freqs[i] = fixed[i] ? 0 : 1;
+    }
+
+    uint64_t free_total = target_total, free_count = cur_total;
+    for (bool changed = true; changed; ) {
+        changed = false;
+        for (int i = 0; i < ALPHABET_SIZE; i++) {
+            if (!fixed[i] && counts[i] * free_total < free_count) {
+                fixed[i] = true;
+                free_total--;
+                free_count -= counts[i];
+                changed = true;
+            }
+        }
+    }
+
+    int64_t assigned = 0;
+    double scale = (double)free_total / free_count;
+    for (int i = 0; i < ALPHABET_SIZE; i++) {
+        if (!fixed[i])
+            freqs[i] = std::max<uint32_t>(1, (uint32_t)(counts[i] * scale + 0.5));
+        assigned += freqs[i];
+    }
+
+    auto gain = [&](int s) { return counts[s] * log2_ratio(freqs[s]); };
+    auto loss = [&](int s) { return counts[s] * log2_ratio(freqs[s] - 1); };
+
+    auto by_max = [](const CostEntry& a, const CostEntry& b) { return a.cost < b.cost; };
+    auto by_min = [](const CostEntry& a, const CostEntry& b) { return a.cost > b.cost; };
+    CostHeap<decltype(by_max), ALPHABET_SIZE> gains(by_max, freqs);
+    CostHeap<decltype(by_min), ALPHABET_SIZE> losses(by_min, freqs);
+
+    auto push = [&](int s) {
+        gains.push({ gain(s), s, freqs[s] });
+        if (freqs[s] > 1)
+            losses.push({ loss(s), s, freqs[s] });
+    };
+    for (int i = 0; i < ALPHABET_SIZE; i++) {
+        if (counts[i])
+            push(i);
+    }
+
+    for (; assigned < target_total; assigned++) {
+        int s = gains.top_valid();
+        freqs[s]++;
+        push(s);
+    }
+    for (; assigned > target_total; assigned--) {
+        int s = losses.top_valid();
+        freqs[s]--;
+        push(s);
+    }
+    // a symbol never pays for its own increment: its loss after the increment equals the gain
+    for (;;) {
+        int inc = gains.top_valid();
+        int dec = losses.top_valid();
+        if (dec < 0 || inc == dec || gains.top_cost() <= losses.top_cost() * (1 + 1e-12))
+            break;
+        freqs[inc]++;
+        freqs[dec]--;
+        push(inc);
+        push(dec);
+    }
+
+    calc_cum_freqs();
+    return true;
 }
+
+template <int ALPHABET_SIZE>
+double BasicSymbolStats<ALPHABET_SIZE>::code_length(const uint32_t* counts) const {
+    double total = std::log2((double)cum_freqs[ALPHABET_SIZE]);
+    double bits = 0;
+    for (int s = 0; s < ALPHABET_SIZE; s++) {
+        if (!counts[s])
+            continue;
+        if (!freqs[s])
+            return INFINITY;
+        bits += counts[s] * (total - std::log2((double)freqs[s]));
+    }
+    return bits;
+}
+
+template struct BasicSymbolStats<256>;
+template struct BasicSymbolStats<4096>;
+template struct BasicSymbolStats<65536>;
@@ -4,6 +4,8 @@
 //
 
 #pragma once
+#include <type_traits>
+#include <stddef.h>
 #include <stdint.h>
 
 #if defined(__GNUC__) || defined(__clang__)
@@ -13,11 +15,56 @@
 #define RESTRICT __restrict
 #endif
 
-struct SymbolStats {
-    uint32_t freqs[256];
-    uint32_t cum_freqs[257];
+enum NormalizeMethod {
+    NORMALIZE_STEAL,        // ryg's rounding, zero-rounded symbols steal from the smallest frequency above 1
+    NORMALIZE_MIN_COST      // minimal expected code length for the counted frequencies
+};
 
-    void count_freqs(uint8_t const* in, size_t nbytes);
+// count_freqs_sampled counts one block of block_size bytes out of every rate blocks: the first one of every group
+// or a random one when random is set. The symbols missing in the sample get the count 1 so that they can still be
+// coded, and each of them then takes a slot of the normalized total; when more than max_unseen symbols are missing,
+// the whole input is counted instead.
+struct SampleParams {
+    size_t block_size = 4096;
+    uint32_t rate = 16;
+    bool random = false;
+    uint64_t seed = 0;
+    uint32_t max_unseen = 256;
+};
+
+// params whose unseen symbols take at most 1/32 of target_total (32 slots at 10 bits, 0.04 bits per symbol), so
+// that a sample cannot cost the low precisions much more than an exact count
+inline SampleParams sample_for_total(SampleParams params, uint32_t target_total) {
+    params.max_unseen = params.max_unseen < target_total / 32 ? params.max_unseen : target_total / 32;
+    return params;
+}
+
+// the frequencies of an alphabet of ALPHABET_SIZE symbols, 256 (bytes), 4096 or 65536 (both in uint16_t);
+// every symbol of the input must be below ALPHABET_SIZE. The 65536 symbol tables take 512 KB, so allocate them
+// on the heap.
+template <int ALPHABET_SIZE>
+struct BasicSymbolStats {
+    static_assert(ALPHABET_SIZE >= 256 && ALPHABET_SIZE <= 65536, "");
+    typedef std::conditional_t<(ALPHABET_SIZE <= 256), uint8_t, uint16_t> symbol_t;
+
+    uint32_t freqs[ALPHABET_SIZE];
+    uint32_t cum_freqs[ALPHABET_SIZE + 1];
+
+    // n is the number of symbols, for bytes the number of bytes
+    void count_freqs(symbol_t const* in, size_t n);
+    // splits inputs of at least min_bytes_per_thread * 2 symbols between threads (0 = hardware concurrency)
+    void count_freqs_parallel(symbol_t const* in, size_t n, unsigned threads = 0, size_t min_bytes_per_thread = 1 << 20);
+    // every symbol of the input can be coded with the result (see SampleParams); block_size counts symbols
+    void count_freqs_sampled(symbol_t const* in, size_t n, const SampleParams& params = {});
     void calc_cum_freqs();
-    void normalize_freqs(uint32_t target_total);
-};
\ No newline at end of file
+    // false and the counts are left as they are if the present symbols outnumber target_total
+    bool normalize_freqs(uint32_t target_total, NormalizeMethod method = NORMALIZE_MIN_COST);
+    bool normalize_freqs_steal(uint32_t target_total);
+    bool normalize_freqs_min_cost(uint32_t target_total);
+    // bits needed to code the symbols with the given counts by the normalized freqs (infinity if one cannot be coded)
+    double code_length(const uint32_t* counts) const;
+};
+
+typedef BasicSymbolStats<256> SymbolStats;
+typedef BasicSymbolStats<4096> SymbolStats12;
+typedef BasicSymbolStats<65536> SymbolStats16;
@@ -0,0 +1,138 @@
+#pragma once
+
+#include <atomic>
+#include <memory>
+#include <mutex>
+#include <vector>
+#include <string.h>
+#include <stdint.h>
+
+#include "sym-stats.h"
+
+//
+// Thread-safe cache of the coding tables keyed by the normalized frequencies, for streams where the same
+// distributions repeat. The tables are handed out as shared immutable objects, so any number of encoders and
+// decoders can use them while they are replaced in the cache. Lookups are lock-free: a slot holds a plain atomic
+// pointer to its entry and a hit copies the shared_ptr kept for that entry in the owner table. An evicted entry
+// goes to the retire list, since a lookup may still be reading it, and is freed by a later miss that sees no lookup
+// in flight (or by the destructor). The owner table holds twice the capacity; when it is full of retired entries
+// that cannot be freed yet, the miss hands out its tables without storing them. A miss builds the tables outside
+// of any lock (two threads missing together both build them), only storing them takes a mutex.
+//
+// TableCache<Rans64SequenceInfo> cache(init_rANS);
+// TableCache<SequenceInfo> cache(RansWithAccuracy3::init);
+//
+
+template <typename Info>
+class TableCache {
+public:
+	typedef Info (*BuildFn)(const SymbolStats& stats);
+
+	// capacity is rounded up to a power of two not less than 2, the sets have 2 entries replaced in turns
+	explicit TableCache(BuildFn build, size_t capacity = 64) : build(build), slots(round_capacity(capacity)), owners(2 * slots.size()) {
+		set_mask = slots.size() / WAYS - 1;
+		for (size_t i = owners.size(); i-- > 0; )
+			free_owners.push_back(i);
+	}
+
+	// stats must be normalized to the total the build function expects
+	std::shared_ptr<const Info> get(const SymbolStats& stats) {
+		uint64_t hash = hash_freqs(stats.freqs);
+		std::atomic<const Entry*>* set = &slots[(hash & set_mask) * WAYS];
+		readers.fetch_add(1);
+		if (const Entry* entry = find(set, hash, stats.freqs)) {
+			std::shared_ptr<const Info> info(owners[entry->owner], &entry->info);
+			readers.fetch_sub(1);
+			hit_count.fetch_add(1, std::memory_order_relaxed);
+			return info;
+		}
+		readers.fetch_sub(1);
+
+		miss_count.fetch_add(1, std::memory_order_relaxed);
+		auto entry = std::make_shared<Entry>();
+		entry->hash = hash;
+		memcpy(entry->freqs, stats.freqs, sizeof(entry->freqs));
+		entry->info = build(stats);
+
+		// the entries are retired and freed only under the mutex, so they can be read here without counting
+		std::lock_guard<std::mutex> lock(store_mutex);
+		if (const Entry* stored = find(set, hash, stats.freqs))         // stored by another thread meanwhile
+			return std::shared_ptr<const Info>(owners[stored->owner], &stored->info);
+		if (free_owners.empty() && readers.load() == 0) {
+			// the retired entries are out of the slots, so the lookups started from now on cannot reach them
+			for (size_t owner : retired) {
+				owners[owner].reset();
+				free_owners.push_back(owner);
+			}
+			retired.clear();
+		}
+		if (free_owners.empty())
+			return std::shared_ptr<const Info>(entry, &entry->info);
+		entry->owner = free_owners.back();
+		free_owners.pop_back();
+		owners[entry->owner] = entry;
+
+		int way = 0;
+		while (way < WAYS && set[way].load(std::memory_order_relaxed))
+			way++;
+		if (way == WAYS) {
+			way = victim++ % WAYS;
+			retired.push_back(set[way].load(std::memory_order_relaxed)->owner);
+		}
+		set[way].store(entry.get());
+		return std::shared_ptr<const Info>(entry, &entry->info);
+	}
+
+	uint64_t hits() const { return hit_count.load(std::memory_order_relaxed); }
+	uint64_t misses() const { return miss_count.load(std::memory_order_relaxed); }
+
+private:
+	static constexpr int WAYS = 2;
+
+	struct Entry {
+		uint64_t hash;
+		size_t owner;           // the index of its shared_ptr in owners
+		uint32_t freqs[256];
+		Info info;
+	};
+
+	static const Entry* find(const std::atomic<const Entry*>* set, uint64_t hash, const uint32_t* freqs) {
+		for (int way = 0; way < WAYS; way++) {
+			const Entry* entry = set[way].load();
+			if (entry && entry->hash == hash && memcmp(entry->freqs, freqs, sizeof(entry->freqs)) == 0)
+				return entry;
+		}
+		return nullptr;
+	}
+
+	static size_t round_capacity(size_t capacity) {
+		size_t size = WAYS;
+		while (size < capacity)
+			size *= 2;
+		return size;
+	}
+
+	static uint64_t hash_freqs(const uint32_t* freqs) {
+		uint64_t hash = 0;
+		for (int s = 0; s < 256; s += 2) {
+			uint64_t word = freqs[s] | (uint64_t)freqs[s + 1] << 32;
+			hash = (hash ^ word) * 0x9E3779B97F4A7C15ull;
+			hash ^= hash >> 29;
+		}
+		return hash;
+	}
+
+	BuildFn build;
+	size_t set_mask;
+	std::vector<std::atomic<const Entry*>> slots;
+	// an owner is set before its entry is published in a slot and reset only when no lookup can reach the entry
+	std::vector<std::shared_ptr<const Entry>> owners;
+	// the lookups in flight, counted with sequentially consistent operations as are the slots, so a miss that
+	// reads 0 after taking an entry out of its slot knows that no lookup still holds it
+	std::atomic<size_t> readers = 0;
+	// the rest is only touched under store_mutex
+	std::vector<size_t> free_owners, retired;
+	uint32_t victim = 0;
+	std::mutex store_mutex;
+	std::atomic<uint64_t> hit_count = 0, miss_count = 0;
+};
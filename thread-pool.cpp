@@ -0,0 +1,103 @@
+#include <algorithm>
+
+#include "thread-pool.h"
+
+ThreadPool::ThreadPool(unsigned threads) {
+    if (threads == 0)
+        threads = std::max(1u, std::thread::hardware_concurrency());
+    for (unsigned t = 0; t < threads; t++)
+        queues.push_back(std::make_unique<Queue>());
+    // the thread 0 is the one calling parallel_for
+    for (unsigned t = 1; t < threads; t++)
+        workers.emplace_back(&ThreadPool::worker, this, t);
+}
+
+ThreadPool::~ThreadPool() {
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        stop = true;
+    }
+    wake.notify_all();
+    for (auto& worker : workers)
+        worker.join();
+}
+
+bool ThreadPool::pop_task(unsigned thread, size_t& task) {
+    {
+        Queue& own = *queues[thread];
+        std::lock_guard<std::mutex> lock(own.mutex);
+        if (!own.tasks.empty()) {
+            task = own.tasks.back();
+            own.tasks.pop_back();
+            return true;
+        }
+    }
+    for (unsigned k = 1; k < queues.size(); k++) {
+        Queue& victim = *queues[(thread + k) % queues.size()];
+        std::lock_guard<std::mutex> lock(victim.mutex);
+        if (!victim.tasks.empty()) {
+            task = victim.tasks.front();
+            victim.tasks.pop_front();
+            return true;
+        }
+    }
+    return false;
+}
+
+void ThreadPool::run_tasks(unsigned thread) {
+    size_t task;
+    while (pop_task(thread, task)) {
+        (*job)(task);
+        if (remaining.fetch_sub(1, std::memory_order_acq_rel) == 1) {
+            std::lock_guard<std::mutex> lock(mutex);
+            done.notify_all();
+        }
+    }
+}
+
+void ThreadPool::worker(unsigned thread) {
+    uint64_t seen = 0;
+    for (;;) {
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+            wake.wait(lock, [&] { return stop || generation != seen; });
+            if (stop)
+                return;
+            seen = generation;
+        }
+        run_tasks(thread);
+    }
+}
+
+void ThreadPool::parallel_for(size_t count, const std::function<void(size_t)>& fn) {
+    if (count == 0)
+        return;
+    if (queues.size() == 1) {
+        for (size_t i = 0; i < count; i++)
+            fn(i);
+        return;
+    }
+
+    // the job is published before the tasks: a thread still looking for the tasks of the previous call
+    // may take a new one as soon as it is in a deque
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        job = &fn;
+        remaining.store(count, std::memory_order_relaxed);
+    }
+    size_t per_thread = (count + queues.size() - 1) / queues.size();
+    for (unsigned t = 0; t < queues.size(); t++) {
+        std::lock_guard<std::mutex> lock(queues[t]->mutex);
+        for (size_t i = t * per_thread; i < std::min(count, (t + 1) * per_thread); i++)
+            queues[t]->tasks.push_back(i);
+    }
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        generation++;
+    }
+    wake.notify_all();
+
+    run_tasks(0);
+    std::unique_lock<std::mutex> lock(mutex);
+    done.wait(lock, [&] { return remaining.load(std::memory_order_acquire) == 0; });
+}
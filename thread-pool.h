@@ -0,0 +1,50 @@
+//
+// Work-stealing thread pool: parallel_for splits the task indices into consecutive ranges in per-thread deques,
+// every thread takes its own tasks from the back and steals from the front of the others when its deque is empty.
+//
+
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+class ThreadPool {
+public:
+    // threads includes the thread calling parallel_for (0 = hardware concurrency)
+    explicit ThreadPool(unsigned threads = 0);
+    ~ThreadPool();
+
+    ThreadPool(const ThreadPool&) = delete;
+    ThreadPool& operator=(const ThreadPool&) = delete;
+
+    unsigned size() const { return (unsigned)queues.size(); }
+
+    // runs fn(0), ..., fn(count - 1) and returns when all of them are done; not reentrant
+    void parallel_for(size_t count, const std::function<void(size_t)>& fn);
+
+private:
+    struct Queue {
+        std::mutex mutex;
+        std::deque<size_t> tasks;
+    };
+
+    bool pop_task(unsigned thread, size_t& task);
+    void run_tasks(unsigned thread);
+    void worker(unsigned thread);
+
+    std::vector<std::unique_ptr<Queue>> queues;
+    std::vector<std::thread> workers;
+
+    std::mutex mutex;
+    std::condition_variable wake, done;
+    uint64_t generation = 0;
+    bool stop = false;
+    const std::function<void(size_t)>* job = nullptr;
+    std::atomic<size_t> remaining = 0;
+};